@@ -0,0 +1,210 @@
+// Copyright 2018-2021 Mickael Daniel. All Rights Reserved.
+
+#include "GameplayDebuggerCategory_TargetSystem.h"
+
+#if WITH_GAMEPLAY_DEBUGGER
+
+#include "TargetSystemComponent.h"
+#include "TargetSystemTypes.h"
+#include "Engine/World.h"
+#include "GameFramework/Actor.h"
+#include "GameFramework/PlayerController.h"
+
+namespace TargetSystem
+{
+	static const TCHAR* GetRejectReasonDescription(const ETargetSystemRejectReason RejectReason)
+	{
+		switch (RejectReason)
+		{
+		case ETargetSystemRejectReason::None:
+			return TEXT("valid");
+		case ETargetSystemRejectReason::NotTargetable:
+			return TEXT("not targetable");
+		case ETargetSystemRejectReason::Occluded:
+			return TEXT("occluded");
+		case ETargetSystemRejectReason::OffScreen:
+			return TEXT("off-screen");
+		case ETargetSystemRejectReason::OutOfRange:
+			return TEXT("out of range");
+		case ETargetSystemRejectReason::WrongSide:
+			return TEXT("wrong side");
+		}
+
+		return TEXT("unknown");
+	}
+
+	static FColor GetRejectReasonColor(const ETargetSystemRejectReason RejectReason, const bool bSelected)
+	{
+		if (bSelected)
+		{
+			return FColor::Green;
+		}
+
+		switch (RejectReason)
+		{
+		case ETargetSystemRejectReason::None:
+			return FColor::Cyan;
+		case ETargetSystemRejectReason::NotTargetable:
+			return FColor(128, 128, 128);
+		case ETargetSystemRejectReason::Occluded:
+			return FColor::Red;
+		case ETargetSystemRejectReason::OffScreen:
+			return FColor::Purple;
+		case ETargetSystemRejectReason::OutOfRange:
+			return FColor::Orange;
+		case ETargetSystemRejectReason::WrongSide:
+			return FColor::Yellow;
+		}
+
+		return FColor::White;
+	}
+}
+
+void FGameplayDebuggerCategory_TargetSystem::FRepData::Serialize(FArchive& Ar)
+{
+	Ar << ComponentName;
+	Ar << LockedOnTargetName;
+	Ar << bIsLocked;
+	Ar << NumLineOfSightTracesAvoided;
+	Ar << NumRecentTargets;
+	Ar << QueryName;
+	Ar << QueryAge;
+	Ar << NumTraces;
+	Ar << NumTracesAvoided;
+	Ar << NumVisibilityCacheHits;
+	Ar << GatherTimeMs;
+	Ar << FilterTimeMs;
+	Ar << ScoreTimeMs;
+
+	int32 NumCandidates = Candidates.Num();
+	Ar << NumCandidates;
+	if (Ar.IsLoading())
+	{
+		Candidates.SetNum(NumCandidates);
+	}
+
+	for (FCandidate& Candidate : Candidates)
+	{
+		Ar << Candidate.ActorName;
+		Ar << Candidate.Location;
+		Ar << Candidate.RejectReason;
+		Ar << Candidate.Score;
+		Ar << Candidate.bSelected;
+	}
+}
+
+FGameplayDebuggerCategory_TargetSystem::FGameplayDebuggerCategory_TargetSystem()
+{
+	SetDataPackReplication<FRepData>(&DataPack);
+}
+
+TSharedRef<FGameplayDebuggerCategory> FGameplayDebuggerCategory_TargetSystem::MakeInstance()
+{
+	return MakeShareable(new FGameplayDebuggerCategory_TargetSystem());
+}
+
+void FGameplayDebuggerCategory_TargetSystem::CollectData(APlayerController* OwnerPC, AActor* DebugActor)
+{
+	DataPack = FRepData();
+
+	const UTargetSystemComponent* TargetSystemComponent = DebugActor ? DebugActor->FindComponentByClass<UTargetSystemComponent>() : nullptr;
+	if (!TargetSystemComponent)
+	{
+		return;
+	}
+
+	const FTargetSystemQueryStats& Stats = TargetSystemComponent->GetLastQueryStats();
+	const UWorld* World = TargetSystemComponent->GetWorld();
+
+	DataPack.ComponentName = TargetSystemComponent->GetName();
+	DataPack.bIsLocked = TargetSystemComponent->IsLocked();
+	DataPack.LockedOnTargetName = GetNameSafe(TargetSystemComponent->GetLockedOnTargetActor());
+	DataPack.NumLineOfSightTracesAvoided = TargetSystemComponent->GetNumLineOfSightTracesAvoided();
+
+	// Last known location of recently locked off targets
+	for (const FTargetSystemRecentTarget& RecentTarget : TargetSystemComponent->GetRecentTargets().GetEntries())
+	{
+		if (RecentTarget.Actor.IsValid())
+		{
+			DataPack.NumRecentTargets++;
+
+			const float Age = World ? static_cast<float>(World->GetTimeSeconds() - RecentTarget.Timestamp) : 0.0f;
+			const FString Description = FString::Printf(TEXT("recent (%.1fs ago%s)"), Age, RecentTarget.bLostSight ? TEXT(", lost sight") : TEXT(""));
+			AddShape(FGameplayDebuggerShape::MakePoint(RecentTarget.LastKnownLocation, 8.0f, FColor::Blue, Description));
+		}
+	}
+	DataPack.QueryName = Stats.QueryName.ToString();
+	DataPack.QueryAge = World && Stats.QueryName != NAME_None ? static_cast<float>(World->GetTimeSeconds() - Stats.Timestamp) : 0.0f;
+	DataPack.NumTraces = Stats.NumTraces;
+	DataPack.NumTracesAvoided = Stats.NumTracesAvoided;
+	DataPack.NumVisibilityCacheHits = Stats.NumVisibilityCacheHits;
+	DataPack.GatherTimeMs = static_cast<float>(Stats.GatherTime * 1000.0);
+	DataPack.FilterTimeMs = static_cast<float>(Stats.FilterTime * 1000.0);
+	DataPack.ScoreTimeMs = static_cast<float>(Stats.ScoreTime * 1000.0);
+
+	const FVector OwnerLocation = DebugActor->GetActorLocation();
+
+	DataPack.Candidates.Reserve(Stats.Candidates.Num());
+	for (const FTargetSystemQueryCandidate& Candidate : Stats.Candidates)
+	{
+		FRepData::FCandidate& RepCandidate = DataPack.Candidates.AddDefaulted_GetRef();
+		RepCandidate.ActorName = GetNameSafe(Candidate.Actor.Get());
+		RepCandidate.Location = Candidate.Location;
+		RepCandidate.RejectReason = static_cast<uint8>(Candidate.RejectReason);
+		RepCandidate.Score = Candidate.Score;
+		RepCandidate.bSelected = Candidate.Actor.IsValid() && Candidate.Actor == Stats.SelectedActor;
+
+		const ETargetSystemRejectReason RejectReason = Candidate.RejectReason;
+		const FColor Color = TargetSystem::GetRejectReasonColor(RejectReason, RepCandidate.bSelected);
+		AddShape(FGameplayDebuggerShape::MakeSegment(OwnerLocation, Candidate.Location, Color));
+		AddShape(FGameplayDebuggerShape::MakePoint(Candidate.Location, 10.0f, Color, TargetSystem::GetRejectReasonDescription(RejectReason)));
+	}
+}
+
+void FGameplayDebuggerCategory_TargetSystem::DrawData(APlayerController* OwnerPC, FGameplayDebuggerCanvasContext& CanvasContext)
+{
+	if (DataPack.ComponentName.IsEmpty())
+	{
+		CanvasContext.Printf(TEXT("{red}No TargetSystemComponent on selected actor"));
+		return;
+	}
+
+	CanvasContext.Printf(TEXT("Component: {yellow}%s"), *DataPack.ComponentName);
+	CanvasContext.Printf(TEXT("Locked: %s%s {white}Target: {yellow}%s"),
+		DataPack.bIsLocked ? TEXT("{green}") : TEXT("{red}"),
+		DataPack.bIsLocked ? TEXT("true") : TEXT("false"),
+		*DataPack.LockedOnTargetName
+	);
+	CanvasContext.Printf(TEXT("Line of sight traces avoided: {yellow}%d"), DataPack.NumLineOfSightTracesAvoided);
+	CanvasContext.Printf(TEXT("Recent targets: {yellow}%d"), DataPack.NumRecentTargets);
+
+	if (DataPack.QueryName.IsEmpty() || DataPack.QueryName == TEXT("None"))
+	{
+		CanvasContext.Printf(TEXT("{grey}No query recorded yet"));
+		return;
+	}
+
+	CanvasContext.Printf(TEXT("Last query: {yellow}%s {white}(%.2fs ago)"), *DataPack.QueryName, DataPack.QueryAge);
+	CanvasContext.Printf(TEXT("Traces: {yellow}%d {white}(avoided: {yellow}%d{white}, cached: {yellow}%d{white}) Gather: {yellow}%.3fms {white}Filter: {yellow}%.3fms {white}Score: {yellow}%.3fms"),
+		DataPack.NumTraces,
+		DataPack.NumTracesAvoided,
+		DataPack.NumVisibilityCacheHits,
+		DataPack.GatherTimeMs,
+		DataPack.FilterTimeMs,
+		DataPack.ScoreTimeMs
+	);
+
+	CanvasContext.Printf(TEXT("Candidates: {yellow}%d"), DataPack.Candidates.Num());
+	for (const FRepData::FCandidate& Candidate : DataPack.Candidates)
+	{
+		const ETargetSystemRejectReason RejectReason = static_cast<ETargetSystemRejectReason>(Candidate.RejectReason);
+		CanvasContext.Printf(TEXT("  %s%s {white}%s - score: %.1f"),
+			Candidate.bSelected ? TEXT("{green}") : TEXT("{white}"),
+			*Candidate.ActorName,
+			TargetSystem::GetRejectReasonDescription(RejectReason),
+			Candidate.Score
+		);
+	}
+}
+
+#endif // WITH_GAMEPLAY_DEBUGGER
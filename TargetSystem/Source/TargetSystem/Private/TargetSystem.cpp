@@ -3,14 +3,36 @@
 #include "TargetSystem.h"
 #include "TargetSystemLog.h"
 
+#if WITH_GAMEPLAY_DEBUGGER
+#include "GameplayDebugger.h"
+#include "GameplayDebuggerCategory_TargetSystem.h"
+#endif
+
 #define LOCTEXT_NAMESPACE "FTargetSystemModule"
 
 void FTargetSystemModule::StartupModule()
 {
+#if WITH_GAMEPLAY_DEBUGGER
+	IGameplayDebugger& GameplayDebuggerModule = IGameplayDebugger::Get();
+	GameplayDebuggerModule.RegisterCategory(
+		"TargetSystem",
+		IGameplayDebugger::FOnGetCategory::CreateStatic(&FGameplayDebuggerCategory_TargetSystem::MakeInstance),
+		EGameplayDebuggerCategoryState::EnabledInGameAndSimulate
+	);
+	GameplayDebuggerModule.NotifyCategoriesChanged();
+#endif
 }
 
 void FTargetSystemModule::ShutdownModule()
 {
+#if WITH_GAMEPLAY_DEBUGGER
+	if (IGameplayDebugger::IsAvailable())
+	{
+		IGameplayDebugger& GameplayDebuggerModule = IGameplayDebugger::Get();
+		GameplayDebuggerModule.UnregisterCategory("TargetSystem");
+		GameplayDebuggerModule.NotifyCategoriesChanged();
+	}
+#endif
 }
 
 #undef LOCTEXT_NAMESPACE
@@ -0,0 +1,383 @@
+// Copyright 2018-2021 Mickael Daniel. All Rights Reserved.
+
+#include "TargetSystemComponent.h"
+#include "TargetSystemLog.h"
+#include "TargetSystemQueryKernels.h"
+#include "TargetSystemSubsystem.h"
+#include "Engine/Level.h"
+#include "Engine/World.h"
+#include "GameFramework/DefaultPawn.h"
+#include "HAL/IConsoleManager.h"
+#include "Math/RandomStream.h"
+#include "UObject/UObjectIterator.h"
+
+/**
+ * Console commands timing the hot paths of UTargetSystemComponent, on the first Target System Component of the world
+ * that has begun play.
+ *
+ * Friend of UTargetSystemComponent and UTargetSystemSubsystem, to call their private functions directly.
+ */
+class FTargetSystemBenchmarks
+{
+public:
+	// TargetSystem.BenchmarkGather [Iterations] [NumActors...]
+	static void BenchmarkGather(const TArray<FString>& Args, UWorld* World);
+
+	// TargetSystem.BenchmarkKernels [Iterations] [NumCandidates]
+	static void BenchmarkKernels(const TArray<FString>& Args, UWorld* World);
+
+	// TargetSystem.BenchmarkRegistry [NumActors] [BudgetMs]
+	static void BenchmarkRegistry(const TArray<FString>& Args, UWorld* World);
+
+private:
+	static UTargetSystemComponent* FindComponent(const UWorld* World);
+
+	// Spawns actors in a disc of Radius around Center, so that the ones out of range can be culled
+	static TArray<AActor*> SpawnTargets(UWorld* World, const FVector& Center, int32 NumActors, float Radius);
+
+	// Returns the average time (in seconds) of one candidate gathering, and the number of candidates gathered
+	static double TimeGatherCandidates(UTargetSystemComponent* Component, ETargetSystemCandidateSource CandidateSource, int32 Iterations, int32& OutNumCandidates);
+
+	struct FKernelCandidate
+	{
+		AActor* Actor;
+		FVector Location;
+	};
+
+	// Returns the average time (in seconds) of filtering Candidates with the given policy
+	template <typename PolicyType>
+	static double TimeFilterCandidates(const PolicyType& Policy, const TargetSystem::FQueryKernelContext& Context, const TArray<FKernelCandidate>& Candidates, int32 Iterations);
+};
+
+namespace TargetSystem
+{
+	static FAutoConsoleCommandWithWorldAndArgs BenchmarkGatherCommand(
+		TEXT("TargetSystem.BenchmarkGather"),
+		TEXT("Times candidate gathering with the ActorIterator and PhysicsOverlap sources, with NumActors extra pawns spawned around the owner (half the area being out of range).\n")
+		TEXT("Usage: TargetSystem.BenchmarkGather [Iterations=100] [NumActors...=0 10 100 1000]"),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&FTargetSystemBenchmarks::BenchmarkGather)
+	);
+
+	static FAutoConsoleCommandWithWorldAndArgs BenchmarkKernelsCommand(
+		TEXT("TargetSystem.BenchmarkKernels"),
+		TEXT("Times candidate filtering kernels per candidate, for each specialized configuration versus the generic (runtime branching) path.\n")
+		TEXT("Usage: TargetSystem.BenchmarkKernels [Iterations=1000] [NumCandidates=256]"),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&FTargetSystemBenchmarks::BenchmarkKernels)
+	);
+
+	static FAutoConsoleCommandWithWorldAndArgs BenchmarkRegistryCommand(
+		TEXT("TargetSystem.BenchmarkRegistry"),
+		TEXT("Streams every loaded level in and out of the target registry at once, with NumActors extra pawns spawned, and times the worst frame with and without time budget.\n")
+		TEXT("Usage: TargetSystem.BenchmarkRegistry [NumActors=10000] [BudgetMs=TargetSystem.RegistryTimeBudgetMs]"),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&FTargetSystemBenchmarks::BenchmarkRegistry)
+	);
+}
+
+void FTargetSystemBenchmarks::BenchmarkGather(const TArray<FString>& Args, UWorld* World)
+{
+	UTargetSystemComponent* Component = FindComponent(World);
+	if (!Component || !IsValid(Component->OwnerActor))
+	{
+		TS_LOG(Warning, TEXT("TargetSystem.BenchmarkGather: No Target System Component found in the world"));
+		return;
+	}
+
+	const int32 Iterations = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 100;
+
+	TArray<int32> Densities;
+	for (int32 Index = 1; Index < Args.Num(); Index++)
+	{
+		Densities.Add(FMath::Max(FCString::Atoi(*Args[Index]), 0));
+	}
+
+	if (Densities.Num() == 0)
+	{
+		Densities = { 0, 10, 100, 1000 };
+	}
+
+	const ETargetSystemCandidateSource PreviousCandidateSource = Component->CandidateSource;
+	const FVector Center = Component->OwnerActor->GetActorLocation();
+
+	// Area of a disc of Sqrt(2) times the range radius is twice the area in range
+	const float SpawnRadius = Component->MinimumDistanceToEnable * UE_SQRT_2;
+
+	for (const int32 NumActors : Densities)
+	{
+		TArray<AActor*> SpawnedActors = SpawnTargets(World, Center, NumActors, SpawnRadius);
+
+		int32 NumIteratorCandidates = 0;
+		int32 NumOverlapCandidates = 0;
+		int32 NumRegistryCandidates = 0;
+		const double IteratorTime = TimeGatherCandidates(Component, ETargetSystemCandidateSource::ActorIterator, Iterations, NumIteratorCandidates);
+		const double OverlapTime = TimeGatherCandidates(Component, ETargetSystemCandidateSource::PhysicsOverlap, Iterations, NumOverlapCandidates);
+		const double RegistryTime = TimeGatherCandidates(Component, ETargetSystemCandidateSource::Registry, Iterations, NumRegistryCandidates);
+
+		TS_LOG(Display, TEXT("TargetSystem.BenchmarkGather: %d extra actors - ActorIterator: %.2fus (%d candidates) - PhysicsOverlap: %.2fus (%d candidates) - Registry: %.2fus (%d candidates)"),
+			SpawnedActors.Num(),
+			IteratorTime * 1000000.0,
+			NumIteratorCandidates,
+			OverlapTime * 1000000.0,
+			NumOverlapCandidates,
+			RegistryTime * 1000000.0,
+			NumRegistryCandidates
+		);
+
+		for (AActor* Actor : SpawnedActors)
+		{
+			Actor->Destroy();
+		}
+	}
+
+	Component->CandidateSource = PreviousCandidateSource;
+}
+
+void FTargetSystemBenchmarks::BenchmarkKernels(const TArray<FString>& Args, UWorld* World)
+{
+	UTargetSystemComponent* Component = FindComponent(World);
+	if (!Component || !IsValid(Component->OwnerActor))
+	{
+		TS_LOG(Warning, TEXT("TargetSystem.BenchmarkKernels: No Target System Component found in the world"));
+		return;
+	}
+
+	const int32 Iterations = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 1000;
+	const int32 NumCandidates = Args.Num() > 1 ? FMath::Max(FCString::Atoi(*Args[1]), 1) : 256;
+
+	TargetSystem::FQueryKernelContext Context = TargetSystem::MakeQueryKernelContext(Component->OwnerActor, Component->OwnerPlayerController, Component->MinimumDistanceToEnable);
+	Context.RangeMin = 0.0f;
+	Context.RangeMax = 180.0f;
+
+	// Synthetic candidates around the owner, about half of them in range. Kernels only read locations.
+	const FRandomStream RandomStream(NumCandidates);
+	TArray<FKernelCandidate> Candidates;
+	Candidates.Reserve(NumCandidates);
+	for (int32 Index = 0; Index < NumCandidates; Index++)
+	{
+		const FVector Offset = RandomStream.GetUnitVector() * RandomStream.FRandRange(0.0f, Component->MinimumDistanceToEnable * 2.0f);
+		Candidates.Add({ nullptr, Context.OwnerLocation + Offset });
+	}
+
+	if (!Context.View.bIsValid)
+	{
+		TS_LOG(Display, TEXT("TargetSystem.BenchmarkKernels: No view for the owner, on screen configurations project with an identity view"));
+		Context.View.bIsValid = true;
+		Context.View.ViewRect = FIntRect(0, 0, 1920, 1080);
+		Context.View.ViewportSize = FVector2D(1920.0f, 1080.0f);
+	}
+
+	for (const bool bProjectOnScreen : { false, true })
+	{
+		for (const bool bFilterBySide : { false, true })
+		{
+			TargetSystem::FRuntimeQueryPolicy RuntimePolicy;
+			RuntimePolicy.bProjectOnScreen = bProjectOnScreen;
+			RuntimePolicy.bFilterBySide = bFilterBySide;
+
+			double SpecializedTime = 0.0;
+			if (bProjectOnScreen && bFilterBySide)
+			{
+				SpecializedTime = TimeFilterCandidates(TargetSystem::TQueryPolicy<true, true>(), Context, Candidates, Iterations);
+			}
+			else if (bProjectOnScreen)
+			{
+				SpecializedTime = TimeFilterCandidates(TargetSystem::TQueryPolicy<true, false>(), Context, Candidates, Iterations);
+			}
+			else if (bFilterBySide)
+			{
+				SpecializedTime = TimeFilterCandidates(TargetSystem::TQueryPolicy<false, true>(), Context, Candidates, Iterations);
+			}
+			else
+			{
+				SpecializedTime = TimeFilterCandidates(TargetSystem::TQueryPolicy<false, false>(), Context, Candidates, Iterations);
+			}
+
+			const double GenericTime = TimeFilterCandidates(RuntimePolicy, Context, Candidates, Iterations);
+
+			TS_LOG(Display, TEXT("TargetSystem.BenchmarkKernels: ProjectOnScreen=%d FilterBySide=%d - Specialized: %.2fns - Generic: %.2fns (per candidate)"),
+				bProjectOnScreen,
+				bFilterBySide,
+				SpecializedTime * 1000000000.0 / NumCandidates,
+				GenericTime * 1000000000.0 / NumCandidates
+			);
+		}
+	}
+}
+
+void FTargetSystemBenchmarks::BenchmarkRegistry(const TArray<FString>& Args, UWorld* World)
+{
+	UTargetSystemSubsystem* Subsystem = World ? World->GetSubsystem<UTargetSystemSubsystem>() : nullptr;
+	if (!Subsystem)
+	{
+		TS_LOG(Warning, TEXT("TargetSystem.BenchmarkRegistry: No Target System Subsystem found in the world"));
+		return;
+	}
+
+	const int32 NumActors = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 0) : 10000;
+	const IConsoleVariable* BudgetVariable = IConsoleManager::Get().FindConsoleVariable(TEXT("TargetSystem.RegistryTimeBudgetMs"));
+	const float BudgetMs = Args.Num() > 1 ? FCString::Atof(*Args[1]) : (BudgetVariable ? BudgetVariable->GetFloat() : 0.5f);
+	const double TimeBudget = BudgetMs / 1000.0;
+
+	const UTargetSystemComponent* Component = FindComponent(World);
+	const FVector Center = Component && IsValid(Component->OwnerActor) ? Component->OwnerActor->GetActorLocation() : FVector::ZeroVector;
+	Subsystem->RegisterTargetableClass(Component ? Component->TargetableActors : TSubclassOf<AActor>(APawn::StaticClass()));
+
+	TArray<AActor*> SpawnedActors = SpawnTargets(World, Center, NumActors, 10000.0f);
+
+	TArray<ULevel*> Levels;
+	for (ULevel* Level : World->GetLevels())
+	{
+		if (Level && Level->bIsVisible)
+		{
+			Levels.Add(Level);
+		}
+	}
+
+	// Every level streaming in at once, registered in a single frame
+	for (ULevel* Level : Levels)
+	{
+		Subsystem->OnLevelAddedToWorld(Level, World);
+	}
+
+	double StartTime = FPlatformTime::Seconds();
+	Subsystem->ProcessPendingLevels(TNumericLimits<double>::Max());
+	const double UnbudgetedTime = FPlatformTime::Seconds() - StartTime;
+	const int32 NumRegistered = Subsystem->GetNumRegisteredTargets();
+
+	// Same with the time budget, one call per frame
+	for (ULevel* Level : Levels)
+	{
+		Subsystem->OnLevelAddedToWorld(Level, World);
+	}
+
+	int32 NumFrames = 0;
+	double MaxFrameTime = 0.0;
+	while (Subsystem->GetNumPendingLevels() > 0)
+	{
+		StartTime = FPlatformTime::Seconds();
+		Subsystem->ProcessPendingLevels(TimeBudget);
+		MaxFrameTime = FMath::Max(MaxFrameTime, FPlatformTime::Seconds() - StartTime);
+		NumFrames++;
+	}
+
+	// Every level streaming out at once
+	StartTime = FPlatformTime::Seconds();
+	for (ULevel* Level : Levels)
+	{
+		Subsystem->OnLevelRemovedFromWorld(Level, World);
+	}
+	const double UnregisterTime = FPlatformTime::Seconds() - StartTime;
+
+	TS_LOG(Display, TEXT("TargetSystem.BenchmarkRegistry: %d levels, %d targets - Unbudgeted: %.3fms in 1 frame - Budgeted (%.3fms): %d frames, worst %.3fms - Unregistering: %.3fms"),
+		Levels.Num(),
+		NumRegistered,
+		UnbudgetedTime * 1000.0,
+		TimeBudget * 1000.0,
+		NumFrames,
+		MaxFrameTime * 1000.0,
+		UnregisterTime * 1000.0
+	);
+
+	for (AActor* Actor : SpawnedActors)
+	{
+		Actor->Destroy();
+	}
+
+	// Levels are still loaded, register them back over the next frames
+	for (ULevel* Level : Levels)
+	{
+		Subsystem->OnLevelAddedToWorld(Level, World);
+	}
+}
+
+template <typename PolicyType>
+double FTargetSystemBenchmarks::TimeFilterCandidates(const PolicyType& Policy, const TargetSystem::FQueryKernelContext& Context, const TArray<FKernelCandidate>& Candidates, const int32 Iterations)
+{
+	TArray<FKernelCandidate> WorkingCandidates;
+	WorkingCandidates.Reserve(Candidates.Num());
+
+	int32 NumRejected = 0;
+	const auto OnRejected = [&NumRejected](const FKernelCandidate&, ETargetSystemRejectReason, float)
+	{
+		NumRejected++;
+	};
+
+	// Time of copying candidates, done before every iteration and not part of the kernel
+	double CopyTime = 0.0;
+
+	const double StartTime = FPlatformTime::Seconds();
+	for (int32 Iteration = 0; Iteration < Iterations; Iteration++)
+	{
+		const double CopyStartTime = FPlatformTime::Seconds();
+		WorkingCandidates = Candidates;
+		CopyTime += FPlatformTime::Seconds() - CopyStartTime;
+
+		TargetSystem::FilterCandidates(Policy, Context, WorkingCandidates, OnRejected);
+	}
+
+	return (FPlatformTime::Seconds() - StartTime - CopyTime) / Iterations;
+}
+
+UTargetSystemComponent* FTargetSystemBenchmarks::FindComponent(const UWorld* World)
+{
+	for (TObjectIterator<UTargetSystemComponent> It; It; ++It)
+	{
+		if (It->GetWorld() == World && It->HasBegunPlay())
+		{
+			return *It;
+		}
+	}
+
+	return nullptr;
+}
+
+TArray<AActor*> FTargetSystemBenchmarks::SpawnTargets(UWorld* World, const FVector& Center, const int32 NumActors, const float Radius)
+{
+	TArray<AActor*> Actors;
+	Actors.Reserve(NumActors);
+
+	// Same layout on every run, to compare results
+	const FRandomStream RandomStream(NumActors);
+
+	FActorSpawnParameters SpawnParameters;
+	SpawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+	for (int32 Index = 0; Index < NumActors; Index++)
+	{
+		const float Angle = RandomStream.FRandRange(0.0f, 2.0f * PI);
+		const float Distance = Radius * FMath::Sqrt(RandomStream.FRand());
+		const FVector Location = Center + FVector(FMath::Cos(Angle) * Distance, FMath::Sin(Angle) * Distance, 0.0f);
+
+		if (AActor* Actor = World->SpawnActor<ADefaultPawn>(Location, FRotator::ZeroRotator, SpawnParameters))
+		{
+			Actors.Add(Actor);
+		}
+	}
+
+	return Actors;
+}
+
+double FTargetSystemBenchmarks::TimeGatherCandidates(UTargetSystemComponent* Component, const ETargetSystemCandidateSource CandidateSource, const int32 Iterations, int32& OutNumCandidates)
+{
+	Component->CandidateSource = CandidateSource;
+
+	// Registers targets right away, instead of over the next frames
+	if (CandidateSource == ETargetSystemCandidateSource::Registry)
+	{
+		if (UTargetSystemSubsystem* Subsystem = Component->GetWorld()->GetSubsystem<UTargetSystemSubsystem>())
+		{
+			Subsystem->RegisterTargetableClass(Component->TargetableActors);
+			Subsystem->ProcessPendingLevels(TNumericLimits<double>::Max());
+		}
+	}
+
+	// Warm up caches and allocations
+	OutNumCandidates = Component->GatherCandidates().Num();
+
+	const double StartTime = FPlatformTime::Seconds();
+	for (int32 Iteration = 0; Iteration < Iterations; Iteration++)
+	{
+		Component->GatherCandidates();
+	}
+
+	return (FPlatformTime::Seconds() - StartTime) / Iterations;
+}
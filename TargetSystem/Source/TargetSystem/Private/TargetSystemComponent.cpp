@@ -3,21 +3,256 @@
 #include "TargetSystemComponent.h"
 #include "EngineUtils.h"
 #include "TargetSystemLog.h"
+#include "TargetSystemQueryKernels.h"
+#include "TargetSystemSubsystem.h"
 #include "TargetSystemTargetableInterface.h"
 #include "TimerManager.h"
-#include "Camera/CameraComponent.h"
+#include "WorldCollision.h"
+#include "Algo/Count.h"
+#include "Async/Async.h"
+#include "AIController.h"
+#include "Components/PrimitiveComponent.h"
 #include "Components/WidgetComponent.h"
 #include "Engine/GameViewportClient.h"
+#if ENGINE_MAJOR_VERSION == 5 && ENGINE_MINOR_VERSION >= 1
+#include "Engine/OverlapResult.h"
+#endif
 #include "Engine/World.h"
 #include "GameFramework/CharacterMovementComponent.h"
+#include "GameFramework/MovementComponent.h"
 #include "GameFramework/Pawn.h"
 #include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+#include "Net/UnrealNetwork.h"
+#include "Perception/AIPerceptionComponent.h"
+#include "Perception/AISense_Sight.h"
+#include "Net/Core/PushModel/PushModel.h"
+#include "Tasks/Task.h"
+
+namespace TargetSystem
+{
+#if !UE_BUILD_SHIPPING
+	static bool bRecordQueryStats = false;
+	static FAutoConsoleVariableRef CVarRecordQueryStats(
+		TEXT("TargetSystem.RecordQueryStats"),
+		bRecordQueryStats,
+		TEXT("Always record the breakdown of target queries, not only while the Gameplay Debugger category displays it.")
+	);
+#endif
+
+	// Query stats keep being recorded for this long (in seconds) after the Gameplay Debugger last read them
+	static constexpr double QueryStatsReadTimeout = 2.0;
+
+	// Adds the time spent in the enclosing scope to one of the FTargetSystemQueryStats phase timers, if enabled
+	struct FScopedQueryTimer
+	{
+		FScopedQueryTimer(double& InAccumulator, const bool bInEnabled)
+			: Accumulator(InAccumulator)
+			, StartTime(bInEnabled ? FPlatformTime::Seconds() : 0.0)
+			, bEnabled(bInEnabled)
+		{
+		}
+
+		~FScopedQueryTimer()
+		{
+			if (bEnabled)
+			{
+				Accumulator += FPlatformTime::Seconds() - StartTime;
+			}
+		}
+
+	private:
+		double& Accumulator;
+		double StartTime;
+		bool bEnabled;
+	};
+
+	// Number of screen grid rows, cells being square
+	static constexpr float ScreenGridRows = 16.0f;
+
+	// Bounds top samples are slightly below the top, so that traces don't graze it
+	static constexpr float BoundsTopRatio = 0.8f;
+
+	// Resolves the visibility sample locations of an actor, computing its bounds at most once
+	struct FVisibilitySampler
+	{
+		FVisibilitySampler(const AActor* InActor, const FVector& InLockPointLocation)
+			: Actor(InActor)
+			, LockPointLocation(InLockPointLocation)
+		{
+		}
+
+		// Returns false if the sample doesn't apply to the actor (ex: missing socket, no colliding component)
+		bool GetLocation(const FTargetSystemVisibilitySample& Sample, FVector& OutLocation)
+		{
+			switch (Sample.Type)
+			{
+			case ETargetSystemVisibilitySampleType::LockPoint:
+				OutLocation = LockPointLocation;
+				return true;
+
+			case ETargetSystemVisibilitySampleType::BoundsCenter:
+			case ETargetSystemVisibilitySampleType::BoundsTop:
+				if (!bHasBounds)
+				{
+					Actor->GetActorBounds(true, BoundsOrigin, BoundsExtent);
+					bHasBounds = true;
+				}
+
+				if (BoundsExtent.IsNearlyZero())
+				{
+					return false;
+				}
+
+				OutLocation = Sample.Type == ETargetSystemVisibilitySampleType::BoundsCenter
+					? BoundsOrigin
+					: BoundsOrigin + FVector(0.0f, 0.0f, BoundsExtent.Z * BoundsTopRatio);
+				return true;
+
+			case ETargetSystemVisibilitySampleType::Socket:
+				{
+					const UMeshComponent* MeshComponent = Actor->FindComponentByClass<UMeshComponent>();
+					if (!MeshComponent || !MeshComponent->DoesSocketExist(Sample.SocketName))
+					{
+						return false;
+					}
+
+					OutLocation = MeshComponent->GetSocketLocation(Sample.SocketName);
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+	private:
+		const AActor* Actor;
+		FVector LockPointLocation;
+		FVector BoundsOrigin = FVector::ZeroVector;
+		FVector BoundsExtent = FVector::ZeroVector;
+		bool bHasBounds = false;
+	};
+
+	enum class ERenderVisibility : uint8
+	{
+		// Never rendered, or without visible primitive: line trace
+		Unknown,
+		Rendered,
+		NotRendered
+	};
+
+	// Render visibility of an actor, from the last time any of its visible primitives was rendered on screen.
+	//
+	// WasRecentlyRendered() can't be used, as shadow passes also update the last render time of off screen primitives.
+	static ERenderVisibility GetRenderVisibility(const UWorld* World, const AActor* Actor, const float Tolerance)
+	{
+		float LastRenderTimeOnScreen = 0.0f;
+		Actor->ForEachComponent<UPrimitiveComponent>(false, [&LastRenderTimeOnScreen](const UPrimitiveComponent* Primitive)
+		{
+			if (Primitive->IsRegistered() && Primitive->IsVisible())
+			{
+				LastRenderTimeOnScreen = FMath::Max(LastRenderTimeOnScreen, Primitive->GetLastRenderTimeOnScreen());
+			}
+		});
+
+		if (LastRenderTimeOnScreen <= 0.0f)
+		{
+			return ERenderVisibility::Unknown;
+		}
+
+		// Render times are written by the renderer, which can lag up to a frame behind the game thread. Anything rendered
+		// within the last two frames is still considered rendered this frame.
+		const float MaxAge = FMath::Max(Tolerance, 2.0f * World->GetDeltaSeconds());
+		return World->GetTimeSeconds() - LastRenderTimeOnScreen <= MaxAge ? ERenderVisibility::Rendered : ERenderVisibility::NotRendered;
+	}
+
+	struct FAsyncCandidate
+	{
+		TWeakObjectPtr<AActor> Actor;
+
+		// Lock point of the actor, and its location. Range is checked against the actor location, like synchronous queries.
+		int32 LockPointIndex = 0;
+		FVector Location = FVector::ZeroVector;
+		FVector ActorLocation = FVector::ZeroVector;
+
+		float Distance = 0.0f;
+		ETargetSystemRejectReason RejectReason = ETargetSystemRejectReason::None;
+		bool bTraceHit = false;
+		bool bSightConfirmed = false;
+
+		// Rejected as occluded from its render state, without tracing (see bUseRenderVisibility)
+		bool bNotRendered = false;
+
+		// Visibility samples tested so far, and the locations traced for them
+		int32 NumSamplesTested = 0;
+		TArray<FVector, TInlineAllocator<4>> TracedLocations;
+	};
+
+	// Distance changes (in units) below which a multi lock candidate keeps its place in the heap
+	static constexpr float MultiLockRescoreTolerance = 10.0f;
+
+	struct FMultiLockCandidate
+	{
+		TWeakObjectPtr<AActor> Actor;
+		float Distance = 0.0f;
+
+		bool operator<(const FMultiLockCandidate& Other) const
+		{
+			return Distance < Other.Distance;
+		}
+	};
+}
+
+struct FTargetSystemAsyncQuery
+{
+	uint32 QueryId = 0;
+	TPromise<TWeakObjectPtr<AActor>> Promise;
+
+	// Snapshot of candidates taken on the game thread, then sorted by distance on the worker thread
+	TArray<TargetSystem::FAsyncCandidate> Candidates;
+
+	// Number of candidates (at the beginning of Candidates) that passed distance / viewport filtering
+	int32 NumValidCandidates = 0;
+	int32 NumPendingTraces = 0;
+
+	// Whether timings and candidates are recorded into the component's query stats (see ShouldRecordQueryStats())
+	bool bRecordStats = false;
+	double GatherTime = 0.0;
+	double FilterTime = 0.0;
+
+	// Traces made on the game thread before the request went async (recent target)
+	int32 NumTraces = 0;
+};
+
+struct FTargetSystemMultiLockState
+{
+	// Min heap of candidates by distance to the owner, kept across updates and only rebuilt every MultiLockRescanInterval.
+	// Candidates that moved in between are pushed again, and their previous entries, whose distance no longer matches
+	// Distances, are skipped when popped.
+	TArray<TargetSystem::FMultiLockCandidate> Heap;
+	double NextRescanTime = 0.0;
+
+	// Current distance to the owner of every candidate in the heap
+	TMap<TObjectKey<AActor>, float> Distances;
+
+	// Candidates popped from the heap by the current update, nearest first, pushed back once it completes
+	TArray<TargetSystem::FAsyncCandidate> Batch;
+
+	// Identifies the current update, so that traces completing after MultiLockOff() are ignored
+	uint32 BatchId = 0;
+	int32 NumPendingTraces = 0;
+};
 
 // Sets default values for this component's properties
 UTargetSystemComponent::UTargetSystemComponent()
 {
 	PrimaryComponentTick.bCanEverTick = true;
 
+	// Only ticks while locked on a target, see TargetLockOn() / TargetLockOff()
+	PrimaryComponentTick.bStartWithTickEnabled = false;
+
+	SetIsReplicatedByDefault(true);
+
 	LockedOnWidgetClass = StaticLoadClass(UObject::StaticClass(), nullptr, TEXT("/TargetSystem/UI/WBP_LockOn.WBP_LockOn_C"));
 	TargetableActors = APawn::StaticClass();
 	TargetableCollisionChannel = ECollisionChannel::ECC_Pawn;
@@ -42,36 +277,86 @@ void UTargetSystemComponent::BeginPlay()
 	}
 
 	SetupLocalPlayerController();
+
+	// Start registering targets early, as loaded levels are registered over the next frames
+	if (CandidateSource == ETargetSystemCandidateSource::Registry)
+	{
+		if (UTargetSystemSubsystem* Subsystem = GetWorld()->GetSubsystem<UTargetSystemSubsystem>())
+		{
+			Subsystem->RegisterTargetableClass(TargetableActors);
+		}
+	}
+}
+
+void UTargetSystemComponent::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	// Owning clients predict their own lock state, see ServerRequestLockOn() / ClientLockOff()
+	FDoRepLifetimeParams Params;
+	Params.bIsPushBased = true;
+	Params.Condition = COND_SkipOwner;
+	DOREPLIFETIME_WITH_PARAMS_FAST(UTargetSystemComponent, ReplicatedLock, Params);
+}
+
+void UTargetSystemComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	CompleteAsyncQuery(nullptr);
+	MultiLockOff();
+	UnbindFromLockedOnTarget();
+	GetWorld()->GetTimerManager().ClearTimer(RegainSightTimerHandle);
+	Super::EndPlay(EndPlayReason);
 }
 
 void UTargetSystemComponent::TickComponent(const float DeltaTime, const ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
 {
 	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
 
+	if (bIsMultiLocked && GetWorld()->GetTimeSeconds() >= NextMultiLockUpdateTime)
+	{
+		UpdateMultiLock();
+	}
+
 	if (!bTargetLocked || !LockedOnTargetActor)
 	{
 		return;
 	}
 
-	if (!TargetIsTargetable(LockedOnTargetActor))
+	if (IsOwnerLocallyControlled())
+	{
+		SetControlRotationOnTarget(LockedOnTargetActor);
+	}
+
+	// Target Locked Off based on Targetable state, every frame as it is a single interface call
+	if (bPollTargetable && !TargetIsTargetable(LockedOnTargetActor))
 	{
 		TargetLockOff();
 		return;
 	}
 
-	SetControlRotationOnTarget(LockedOnTargetActor);
-
 	// Target Locked Off based on Distance
-	if (GetDistanceFromCharacter(LockedOnTargetActor) > MinimumDistanceToEnable)
+	const double WorldTime = GetWorld()->GetTimeSeconds();
+	if (WorldTime >= NextDistanceCheckTime)
 	{
-		TargetLockOff();
+		UpdateDistanceCheck(WorldTime);
+		if (!bTargetLocked)
+		{
+			return;
+		}
+	}
+
+	// No need to check line of sight again while already waiting to break it
+	if (bIsBreakingLineOfSight || WorldTime < NextLineOfSightCheckTime)
+	{
+		return;
 	}
 
-	if (ShouldBreakLineOfSight() && !bIsBreakingLineOfSight)
+	NextLineOfSightCheckTime = WorldTime + LineOfSightCheckInterval;
+	if (ShouldBreakLineOfSight())
 	{
 		if (BreakLineOfSightDelay <= 0)
 		{
-			TargetLockOff();
+			LockOffFromLineOfSight();
 		}
 		else
 		{
@@ -88,6 +373,7 @@ void UTargetSystemComponent::TickComponent(const float DeltaTime, const ELevelTi
 
 void UTargetSystemComponent::TargetActor()
 {
+	CompleteAsyncQuery(nullptr);
 	ClosestTargetDistance = MinimumDistanceToEnable;
 
 	if (bTargetLocked)
@@ -96,266 +382,1405 @@ void UTargetSystemComponent::TargetActor()
 	}
 	else
 	{
-		const TArray<AActor*> Actors = GetAllActorsOfClass(TargetableActors);
-		LockedOnTargetActor = FindNearestTarget(Actors);
-		TargetLockOn(LockedOnTargetActor);
+		BeginQueryStats(FName("TargetActor"));
+
+		// Locking back on a recently locked off target only costs a single trace
+		int32 LockPointIndex = 0;
+		LockedOnTargetActor = bPreferRecentTargets ? FindRecentTarget(false, LockPointIndex) : nullptr;
+
+		if (!LockedOnTargetActor && ShouldUseScreenGrid())
+		{
+			LockedOnTargetActor = FindTargetClosestToCrosshair(LockPointIndex);
+		}
+		else if (!LockedOnTargetActor)
+		{
+			TArray<AActor*> Actors;
+			{
+				TargetSystem::FScopedQueryTimer GatherTimer(LastQueryStats.GatherTime, bIsRecordingQuery);
+				Actors = GatherCandidates();
+			}
+
+			LockedOnTargetActor = FindNearestTarget(Actors, LockPointIndex);
+		}
+
+		EndQueryStats(LockedOnTargetActor);
+
+		TargetLockOn(LockedOnTargetActor, LockPointIndex);
 	}
 }
 
-void UTargetSystemComponent::TargetActorWithAxisInput(const float AxisValue)
+TFuture<TWeakObjectPtr<AActor>> UTargetSystemComponent::TargetActorAsync()
 {
-	// If we're not locked on, do nothing
-	if (!bTargetLocked)
-	{
-		return;
-	}
+	// Supersede any in flight request
+	CompleteAsyncQuery(nullptr);
 
-	if (!LockedOnTargetActor)
-	{
-		return;
-	}
+	const TSharedRef<FTargetSystemAsyncQuery> Query = MakeShared<FTargetSystemAsyncQuery>();
+	Query->QueryId = ++LastAsyncQueryId;
+	TFuture<TWeakObjectPtr<AActor>> Future = Query->Promise.GetFuture();
 
-	// If we're not allowed to switch target, do nothing
-	if (!ShouldSwitchTargetActor(AxisValue))
+	if (bTargetLocked)
 	{
-		return;
+		TargetLockOff();
+		Query->Promise.SetValue(TWeakObjectPtr<AActor>());
+		OnTargetActorAsyncCompleted.Broadcast(nullptr);
+		return Future;
 	}
 
-	// If we're switching target, do nothing for a set amount of time
-	if (bIsSwitchingTarget)
+	if (!IsValid(OwnerActor))
 	{
-		return;
+		Query->Promise.SetValue(TWeakObjectPtr<AActor>());
+		OnTargetActorAsyncCompleted.Broadcast(nullptr);
+		return Future;
 	}
 
-	// Lock off target
-	AActor* CurrentTarget = LockedOnTargetActor;
+	// Recast PlayerController in case it wasn't already setup on Begin Play (local split screen)
+	SetupLocalPlayerController();
 
-	// Depending on Axis Value negative / positive, set Direction to Look for (negative: left, positive: right)
-	const float RangeMin = AxisValue < 0 ? 0 : 180;
-	const float RangeMax = AxisValue < 0 ? 180 : 360;
+	// The screen grid already keeps the crosshair query cheap, and is only up to date on the game thread
+	if (ShouldUseScreenGrid())
+	{
+		TargetActor();
 
-	// Reset Closest Target Distance to Minimum Distance to Enable
-	ClosestTargetDistance = MinimumDistanceToEnable;
+		AActor* LockedOnActor = bTargetLocked ? LockedOnTargetActor : nullptr;
+		Query->Promise.SetValue(TWeakObjectPtr<AActor>(LockedOnActor));
+		OnTargetActorAsyncCompleted.Broadcast(LockedOnActor);
+		return Future;
+	}
 
-	// Get All Actors of Class
-	TArray<AActor*> Actors = GetAllActorsOfClass(TargetableActors);
+	// Locking back on a recently locked off target only costs a single trace, not worth a request
+	if (bPreferRecentTargets)
+	{
+		BeginQueryStats(FName("TargetActorAsync"));
 
-	// For each of these actors, check line trace and ignore Current Target and build the list of actors to look from
-	TArray<AActor*> ActorsToLook;
+		int32 LockPointIndex = 0;
+		AActor* RecentTarget = FindRecentTarget(false, LockPointIndex);
+		Query->NumTraces = LastQueryStats.NumTraces;
 
-	TArray<AActor*> ActorsToIgnore;
-	ActorsToIgnore.Add(CurrentTarget);
-	for (AActor* Actor : Actors)
-	{
-		const bool bHit = LineTraceForActor(Actor, ActorsToIgnore);
-		if (bHit && IsInViewport(Actor))
+		EndQueryStats(RecentTarget);
+
+		if (RecentTarget)
 		{
-			ActorsToLook.Add(Actor);
+			LockedOnTargetActor = RecentTarget;
+			TargetLockOn(RecentTarget, LockPointIndex);
+			Query->Promise.SetValue(TWeakObjectPtr<AActor>(RecentTarget));
+			OnTargetActorAsyncCompleted.Broadcast(RecentTarget);
+			return Future;
 		}
 	}
 
-	// Find Targets in Range (left or right, based on Character and CurrentTarget)
-	TArray<AActor*> TargetsInRange = FindTargetsInRange(ActorsToLook, RangeMin, RangeMax);
+	PendingAsyncQuery = Query;
+	Query->bRecordStats = ShouldRecordQueryStats();
 
-	// For each of these targets in range, get the closest one to current target
-	AActor* ActorToTarget = nullptr;
-	for (AActor* Actor : TargetsInRange)
+	// Snapshot candidates and view on the game thread. IsTargetable() may be implemented in Blueprints and can't run
+	// elsewhere, and lock point components are resolved here as well.
+	TargetSystem::FViewSnapshot View;
 	{
-		// and filter out any character too distant from minimum distance to enable
-		const float Distance = GetDistanceFromCharacter(Actor);
-		if (Distance < MinimumDistanceToEnable)
+		TargetSystem::FScopedQueryTimer GatherTimer(Query->GatherTime, Query->bRecordStats);
+
+		for (AActor* Actor : GatherCandidates())
 		{
-			const float RelativeActorsDistance = CurrentTarget->GetDistanceTo(Actor);
-			if (RelativeActorsDistance < ClosestTargetDistance)
+			const bool bSightConfirmed = SightConfirmedCandidates.Contains(Actor);
+			const TConstArrayView<FTargetSystemLockPoint> LockPoints = GetLockPoints(Actor);
+			for (int32 LockPointIndex = 0; LockPointIndex < LockPoints.Num(); LockPointIndex++)
 			{
-				ClosestTargetDistance = RelativeActorsDistance;
-				ActorToTarget = Actor;
+				const FTargetSystemLockPoint& LockPoint = LockPoints[LockPointIndex];
+				const USceneComponent* Component = UTargetSystemSubsystem::FindLockPointComponent(Actor, LockPoint);
+
+				TargetSystem::FAsyncCandidate& Candidate = Query->Candidates.AddDefaulted_GetRef();
+				Candidate.Actor = Actor;
+				Candidate.LockPointIndex = LockPointIndex;
+				Candidate.Location = UTargetSystemSubsystem::GetLockPointLocation(Actor, Component, LockPoint);
+				Candidate.ActorLocation = Actor->GetActorLocation();
+				Candidate.bSightConfirmed = bSightConfirmed;
 			}
 		}
+
+		// Snapshot of the view, so that candidates can be projected on screen from a worker thread
+		View = TargetSystem::CaptureView(OwnerPlayerController);
 	}
 
-	if (ActorToTarget)
+	const FVector OwnerLocation = OwnerActor->GetActorLocation();
+	const float MaxDistance = MinimumDistanceToEnable;
+	TWeakObjectPtr<UTargetSystemComponent> WeakThis(this);
+
+	UE::Tasks::Launch(UE_SOURCE_LOCATION, [WeakThis, Query, View, OwnerLocation, MaxDistance]()
 	{
-		if (SwitchingTargetTimerHandle.IsValid())
 		{
-			SwitchingTargetTimerHandle.Invalidate();
-		}
-
-		TargetLockOff();
-		LockedOnTargetActor = ActorToTarget;
-		TargetLockOn(ActorToTarget);
+			TargetSystem::FScopedQueryTimer FilterTimer(Query->FilterTime, Query->bRecordStats);
 
-		GetWorld()->GetTimerManager().SetTimer(
-			SwitchingTargetTimerHandle,
-			this,
-			&UTargetSystemComponent::ResetIsSwitchingTarget,
-			// Less sticky if still switching
-			bIsSwitchingTarget ? 0.25f : 0.5f
-		);
+			for (TargetSystem::FAsyncCandidate& Candidate : Query->Candidates)
+			{
+				Candidate.Distance = FVector::Dist(OwnerLocation, Candidate.Location);
+				if (FVector::Dist(OwnerLocation, Candidate.ActorLocation) >= MaxDistance)
+				{
+					Candidate.RejectReason = ETargetSystemRejectReason::OutOfRange;
+					continue;
+				}
+
+				if (View.bIsValid && !TargetSystem::IsOnScreen(View, Candidate.Location))
+				{
+					Candidate.RejectReason = ETargetSystemRejectReason::OffScreen;
+				}
+			}
 
-		bIsSwitchingTarget = true;
-	}
-}
+			// Valid candidates first, nearest first
+			Query->Candidates.StableSort([](const TargetSystem::FAsyncCandidate& A, const TargetSystem::FAsyncCandidate& B)
+			{
+				const bool bIsAValid = A.RejectReason == ETargetSystemRejectReason::None;
+				const bool bIsBValid = B.RejectReason == ETargetSystemRejectReason::None;
+				return bIsAValid != bIsBValid ? bIsAValid : A.Distance < B.Distance;
+			});
 
-bool UTargetSystemComponent::GetTargetLockedStatus()
-{
-	return bTargetLocked;
-}
+			Query->NumValidCandidates = Algo::CountIf(Query->Candidates, [](const TargetSystem::FAsyncCandidate& Candidate)
+			{
+				return Candidate.RejectReason == ETargetSystemRejectReason::None;
+			});
+		}
 
-AActor* UTargetSystemComponent::GetLockedOnTargetActor() const
-{
-	return LockedOnTargetActor;
-}
+		AsyncTask(ENamedThreads::GameThread, [WeakThis, Query]()
+		{
+			if (UTargetSystemComponent* Component = WeakThis.Get())
+			{
+				Component->IssueAsyncTraces(Query);
+			}
+		});
+	});
 
-bool UTargetSystemComponent::IsLocked() const
-{
-	return bTargetLocked && LockedOnTargetActor;
+	return Future;
 }
 
-TArray<AActor*> UTargetSystemComponent::FindTargetsInRange(TArray<AActor*> ActorsToLook, const float RangeMin, const float RangeMax) const
+void UTargetSystemComponent::K2_TargetActorAsync()
 {
-	TArray<AActor*> ActorsInRange;
-
-	for (AActor* Actor : ActorsToLook)
-	{
-		const float Angle = GetAngleUsingCameraRotation(Actor);
-		if (Angle > RangeMin && Angle < RangeMax)
-		{
-			ActorsInRange.Add(Actor);
-		}
-	}
-
-	return ActorsInRange;
+	TargetActorAsync();
 }
 
-float UTargetSystemComponent::GetAngleUsingCameraRotation(const AActor* ActorToLook) const
+void UTargetSystemComponent::IssueAsyncTraces(const TSharedRef<FTargetSystemAsyncQuery>& Query)
 {
-	UCameraComponent* CameraComponent = OwnerActor->FindComponentByClass<UCameraComponent>();
-	if (!CameraComponent)
+	// Superseded while filtering on the worker thread, the request has already been resolved
+	if (PendingAsyncQuery.Get() != &Query.Get())
 	{
-		// Fallback to CharacterRotation if no CameraComponent can be found
-		return GetAngleUsingCharacterRotation(ActorToLook);
+		return;
 	}
 
-	const FRotator CameraWorldRotation = CameraComponent->GetComponentRotation();
-	const FRotator LookAtRotation = FindLookAtRotation(CameraComponent->GetComponentLocation(), ActorToLook->GetActorLocation());
-
-	float YawAngle = CameraWorldRotation.Yaw - LookAtRotation.Yaw;
-	if (YawAngle < 0)
+	UWorld* World = GetWorld();
+	if (!IsValid(World) || !IsValid(OwnerActor) || Query->NumValidCandidates == 0)
 	{
-		YawAngle = YawAngle + 360;
+		FinishAsyncQuery();
+		return;
 	}
 
-	return YawAngle;
-}
+	FCollisionQueryParams Params = FCollisionQueryParams(FName("LineTraceSingle"));
+	Params.AddIgnoredActor(OwnerActor);
 
-float UTargetSystemComponent::GetAngleUsingCharacterRotation(const AActor* ActorToLook) const
-{
-	const FRotator CharacterRotation = OwnerActor->GetActorRotation();
-	const FRotator LookAtRotation = FindLookAtRotation(OwnerActor->GetActorLocation(), ActorToLook->GetActorLocation());
+	const FTraceDelegate TraceDelegate = FTraceDelegate::CreateUObject(this, &UTargetSystemComponent::OnAsyncTraceCompleted, Query->QueryId);
+	const FVector Start = OwnerActor->GetActorLocation();
 
-	float YawAngle = CharacterRotation.Yaw - LookAtRotation.Yaw;
-	if (YawAngle < 0)
+	// Traces are issued in rounds of one visibility sample per candidate, the next round being issued once all traces
+	// of the current one completed. Only candidates nearer than the nearest visible one need another round, so that
+	// most candidates are only traced once.
+	const int32 NumSamples = FMath::Max(VisibilitySamples.Num(), 1);
+	for (int32 Index = 0; Index < Query->NumValidCandidates; Index++)
 	{
-		YawAngle = YawAngle + 360;
-	}
-
-	return YawAngle;
-}
-
-FRotator UTargetSystemComponent::FindLookAtRotation(const FVector Start, const FVector Target)
-{
-	return FRotationMatrix::MakeFromX(Target - Start).Rotator();
-}
-
-void UTargetSystemComponent::ResetIsSwitchingTarget()
-{
-	bIsSwitchingTarget = false;
-	bDesireToSwitch = false;
-}
+		TargetSystem::FAsyncCandidate& Candidate = Query->Candidates[Index];
+		const AActor* Actor = Candidate.Actor.Get();
+		if (!IsValid(Actor))
+		{
+			continue;
+		}
 
-bool UTargetSystemComponent::ShouldSwitchTargetActor(const float AxisValue)
-{
-	// Sticky feeling computation
-	if (bEnableStickyTarget)
-	{
-		StartRotatingStack += (AxisValue != 0) ? AxisValue * AxisMultiplier : (StartRotatingStack > 0 ? -AxisMultiplier : AxisMultiplier);
+		if (Candidate.bSightConfirmed)
+		{
+			Candidate.bTraceHit = true;
+		}
 
-		if (AxisValue == 0 && FMath::Abs(StartRotatingStack) <= AxisMultiplier)
+		// Candidates are sorted nearest first, further ones can't be selected
+		if (Candidate.bTraceHit)
 		{
-			StartRotatingStack = 0.0f;
+			break;
 		}
 
-		// If Axis value does not exceeds configured threshold, do nothing
-		if (FMath::Abs(StartRotatingStack) < StickyRotationThreshold)
+		// Not rendered for a while, same as HasLineOfSightToCandidate()
+		if (Candidate.NumSamplesTested == 0 && ShouldUseRenderVisibility()
+			&& TargetSystem::GetRenderVisibility(World, Actor, RenderVisibilityTolerance) == TargetSystem::ERenderVisibility::NotRendered)
 		{
-			bDesireToSwitch = false;
-			return false;
+			Candidate.RejectReason = ETargetSystemRejectReason::Occluded;
+			Candidate.bNotRendered = true;
+			Candidate.NumSamplesTested = NumSamples;
+			continue;
 		}
 
-		//Sticky when switching target.
-		if (StartRotatingStack * AxisValue > 0)
+		FVector SampleLocation;
+		bool bHasSample = false;
+		TargetSystem::FVisibilitySampler Sampler(Actor, Candidate.Location);
+		while (!bHasSample && Candidate.NumSamplesTested < NumSamples)
 		{
-			StartRotatingStack = StartRotatingStack > 0 ? StickyRotationThreshold : -StickyRotationThreshold;
+			bHasSample = Sampler.GetLocation(GetVisibilitySample(Candidate.NumSamplesTested++), SampleLocation)
+				&& !Candidate.TracedLocations.ContainsByPredicate([&SampleLocation](const FVector& Location)
+				{
+					return Location.Equals(SampleLocation, 1.0f);
+				});
 		}
-		else if (StartRotatingStack * AxisValue < 0)
+
+		// Every sample is occluded
+		if (!bHasSample)
 		{
-			StartRotatingStack = StartRotatingStack * -1.0f;
+			continue;
 		}
 
-		bDesireToSwitch = true;
+		Candidate.TracedLocations.Add(SampleLocation);
+		World->AsyncLineTraceByChannel(
+			EAsyncTraceType::Single,
+			Start,
+			SampleLocation,
+			TargetableCollisionChannel,
+			Params,
+			FCollisionResponseParams::DefaultResponseParam,
+			&TraceDelegate,
+			Index
+		);
 
-		return true;
+		Query->NumPendingTraces++;
 	}
 
-	// Non Sticky feeling, check Axis value exceeds threshold
-	return FMath::Abs(AxisValue) > StartRotatingThreshold;
+	if (Query->NumPendingTraces == 0)
+	{
+		FinishAsyncQuery();
+	}
 }
 
-void UTargetSystemComponent::TargetLockOn(AActor* TargetToLockOn)
+void UTargetSystemComponent::OnAsyncTraceCompleted(const FTraceHandle& TraceHandle, FTraceDatum& TraceDatum, const uint32 QueryId)
 {
-	if (!IsValid(TargetToLockOn))
+	if (!PendingAsyncQuery || PendingAsyncQuery->QueryId != QueryId)
 	{
 		return;
 	}
 
-	// Recast PlayerController in case it wasn't already setup on Begin Play (local split screen)
-	SetupLocalPlayerController();
+	FTargetSystemAsyncQuery& Query = *PendingAsyncQuery;
+	if (!Query.Candidates.IsValidIndex(TraceDatum.UserData))
+	{
+		return;
+	}
 
-	bTargetLocked = true;
-	if (bShouldDrawLockedOnWidget)
+	TargetSystem::FAsyncCandidate& Candidate = Query.Candidates[TraceDatum.UserData];
+	Candidate.bTraceHit = TraceDatum.OutHits.Num() > 0 && TraceDatum.OutHits[0].GetActor() == Candidate.Actor.Get();
+	Candidate.RejectReason = Candidate.bTraceHit ? ETargetSystemRejectReason::None : ETargetSystemRejectReason::Occluded;
+
+	// Next round of visibility samples, finishing the request when there is nothing left to trace
+	Query.NumPendingTraces--;
+	if (Query.NumPendingTraces == 0)
 	{
-		CreateAndAttachTargetLockedOnWidgetComponent(TargetToLockOn);
+		IssueAsyncTraces(PendingAsyncQuery.ToSharedRef());
 	}
+}
 
-	if (bShouldControlRotation)
+void UTargetSystemComponent::FinishAsyncQuery()
+{
+	if (!PendingAsyncQuery)
 	{
-		ControlRotation(true);
+		return;
 	}
 
-	if (bAdjustPitchBasedOnDistanceToTarget || bIgnoreLookInput)
+	const TSharedPtr<FTargetSystemAsyncQuery> QueryPtr = PendingAsyncQuery;
+	const FTargetSystemAsyncQuery& Query = *QueryPtr;
+
+	// Candidates are sorted nearest first. Re-validate against the current state of the world, as actors may have
+	// been destroyed, become untargetable or moved out of range while the request was in flight.
+	AActor* SelectedActor = nullptr;
+	int32 SelectedLockPointIndex = 0;
+	for (int32 Index = 0; Index < Query.NumValidCandidates; Index++)
 	{
-		if (IsValid(OwnerPlayerController))
+		const TargetSystem::FAsyncCandidate& Candidate = Query.Candidates[Index];
+		AActor* Actor = Candidate.Actor.Get();
+		if (Candidate.bTraceHit && IsValid(Actor) && TargetIsTargetable(Actor) && GetDistanceFromCharacter(Actor) < MinimumDistanceToEnable)
 		{
-			OwnerPlayerController->SetIgnoreLookInput(true);
+			SelectedActor = Actor;
+			SelectedLockPointIndex = Candidate.LockPointIndex;
+			break;
 		}
 	}
 
-	if (OnTargetLockedOn.IsBound())
+	if (Query.bRecordStats)
 	{
-		OnTargetLockedOn.Broadcast(TargetToLockOn);
-	}
-}
+		const UWorld* World = GetWorld();
+		LastQueryStats.Reset(FName("TargetActorAsync"), World ? World->GetTimeSeconds() : 0.0);
+		LastQueryStats.GatherTime = Query.GatherTime;
+		LastQueryStats.FilterTime = Query.FilterTime;
+		LastQueryStats.NumTraces = Query.NumTraces;
+		for (const TargetSystem::FAsyncCandidate& Candidate : Query.Candidates)
+		{
+			// Lock points of the same actor share its entry, only the selected one is recorded for the selected actor
+			if (Candidate.Actor.Get() != SelectedActor || Candidate.LockPointIndex == SelectedLockPointIndex)
+			{
+				FTargetSystemQueryCandidate& StatsCandidate = LastQueryStats.FindOrAddCandidate(Candidate.Actor.Get());
+				StatsCandidate.Location = Candidate.ActorLocation;
+				StatsCandidate.RejectReason = Candidate.RejectReason;
+				StatsCandidate.Score = Candidate.Distance;
+			}
 
-void UTargetSystemComponent::TargetLockOff()
-{
-	// Recast PlayerController in case it wasn't already setup on Begin Play (local split screen)
-	SetupLocalPlayerController();
+			LastQueryStats.NumTraces += Candidate.TracedLocations.Num();
+			LastQueryStats.NumTracesAvoided += (Candidate.bTraceHit && Candidate.bSightConfirmed) || Candidate.bNotRendered ? 1 : 0;
+		}
+		LastQueryStats.SelectedActor = SelectedActor;
+	}
 
-	bTargetLocked = false;
-	if (TargetLockedOnWidgetComponent)
+	// A lock may have been made another way while the request was in flight, which this request then didn't change
+	AActor* LockedOnActor = nullptr;
+	if (SelectedActor && !bTargetLocked)
 	{
-		TargetLockedOnWidgetComponent->DestroyComponent();
+		LockedOnTargetActor = SelectedActor;
+		TargetLockOn(SelectedActor, SelectedLockPointIndex);
+		LockedOnActor = SelectedActor;
+	}
+
+	CompleteAsyncQuery(LockedOnActor);
+}
+
+void UTargetSystemComponent::CompleteAsyncQuery(AActor* SelectedActor)
+{
+	if (!PendingAsyncQuery)
+	{
+		return;
+	}
+
+	// Reset first, so that a new request made from the delegate isn't superseded right away
+	const TSharedPtr<FTargetSystemAsyncQuery> Query = MoveTemp(PendingAsyncQuery);
+	PendingAsyncQuery.Reset();
+
+	Query->Promise.SetValue(TWeakObjectPtr<AActor>(SelectedActor));
+	OnTargetActorAsyncCompleted.Broadcast(SelectedActor);
+}
+
+void UTargetSystemComponent::TargetActorWithAxisInput(const float AxisValue)
+{
+	// If we're not locked on, do nothing
+	if (!bTargetLocked)
+	{
+		return;
+	}
+
+	if (!LockedOnTargetActor)
+	{
+		return;
+	}
+
+	// If we're not allowed to switch target, do nothing
+	if (!ShouldSwitchTargetActor(AxisValue))
+	{
+		return;
+	}
+
+	// If we're switching target, do nothing for a set amount of time
+	if (bIsSwitchingTarget)
+	{
+		return;
+	}
+
+	// Lock off target
+	AActor* CurrentTarget = LockedOnTargetActor;
+
+	BeginQueryStats(FName("TargetActorWithAxisInput"));
+
+	// In screen space, axis input switches to the nearest target on the left or right of the current one
+	int32 LockPointIndex = 0;
+	AActor* ActorToTarget = ShouldUseScreenGrid()
+		? FindTargetInScreenDirection(CurrentTarget, FVector2D(AxisValue < 0 ? -1.0f : 1.0f, 0.0f), LockPointIndex)
+		: FindTargetAroundCharacter(CurrentTarget, AxisValue);
+
+	EndQueryStats(ActorToTarget);
+
+	if (ActorToTarget)
+	{
+		SwitchToTarget(ActorToTarget, LockPointIndex);
+	}
+}
+
+void UTargetSystemComponent::TargetActorWithStickInput(const FVector2D StickInput)
+{
+	if (!bTargetLocked || !LockedOnTargetActor)
+	{
+		return;
+	}
+
+	// Without a screen grid, only the horizontal part of the stick is meaningful
+	if (!ShouldUseScreenGrid())
+	{
+		TargetActorWithAxisInput(StickInput.X);
+		return;
+	}
+
+	if (!ShouldSwitchTargetActorWithStick(StickInput))
+	{
+		return;
+	}
+
+	if (bIsSwitchingTarget)
+	{
+		return;
+	}
+
+	AActor* CurrentTarget = LockedOnTargetActor;
+
+	BeginQueryStats(FName("TargetActorWithStickInput"));
+
+	// Stick Y points up, screen Y points down
+	int32 LockPointIndex = 0;
+	AActor* ActorToTarget = FindTargetInScreenDirection(CurrentTarget, FVector2D(StickInput.X, -StickInput.Y).GetSafeNormal(), LockPointIndex);
+
+	EndQueryStats(ActorToTarget);
+
+	if (ActorToTarget)
+	{
+		SwitchToTarget(ActorToTarget, LockPointIndex);
+	}
+}
+
+void UTargetSystemComponent::SwitchToTarget(AActor* ActorToTarget, const int32 LockPointIndex)
+{
+	if (SwitchingTargetTimerHandle.IsValid())
+	{
+		SwitchingTargetTimerHandle.Invalidate();
+	}
+
+	TargetLockOff();
+	LockedOnTargetActor = ActorToTarget;
+	TargetLockOn(ActorToTarget, LockPointIndex);
+
+	GetWorld()->GetTimerManager().SetTimer(
+		SwitchingTargetTimerHandle,
+		this,
+		&UTargetSystemComponent::ResetIsSwitchingTarget,
+		// Less sticky if still switching
+		bIsSwitchingTarget ? 0.25f : 0.5f
+	);
+
+	bIsSwitchingTarget = true;
+}
+
+AActor* UTargetSystemComponent::FindTargetAroundCharacter(AActor* CurrentTarget, const float AxisValue)
+{
+	TargetSystem::FQueryKernelContext Context = TargetSystem::MakeQueryKernelContext(OwnerActor, OwnerPlayerController, MinimumDistanceToEnable);
+
+	// Depending on Axis Value negative / positive, set Direction to Look for (negative: left, positive: right)
+	Context.RangeMin = AxisValue < 0 ? 0 : 180;
+	Context.RangeMax = AxisValue < 0 ? 180 : 360;
+
+	// Reset Closest Target Distance to Minimum Distance to Enable
+	ClosestTargetDistance = MinimumDistanceToEnable;
+
+	// Get All Actors of Class
+	TArray<AActor*> Actors;
+	{
+		TargetSystem::FScopedQueryTimer GatherTimer(LastQueryStats.GatherTime, bIsRecordingQuery);
+		Actors = GatherCandidates();
+	}
+
+	struct FSideCandidate
+	{
+		AActor* Actor;
+		FVector Location;
+		float Distance;
+	};
+
+	// Filter out candidates out of range, off screen or not on the requested side (left or right, based on
+	// Character and CurrentTarget), before any line trace
+	TArray<FSideCandidate> Candidates;
+	{
+		TargetSystem::FScopedQueryTimer FilterTimer(LastQueryStats.FilterTime, bIsRecordingQuery);
+
+		Candidates.Reserve(Actors.Num());
+		for (AActor* Actor : Actors)
+		{
+			if (Actor != CurrentTarget)
+			{
+				Candidates.Add({ Actor, Actor->GetActorLocation(), 0.0f });
+			}
+		}
+
+		TargetSystem::DispatchFilterCandidates(true, Context, Candidates, [this](const FSideCandidate& Candidate, const ETargetSystemRejectReason RejectReason, const float Score)
+		{
+			RecordCandidate(Candidate.Actor, RejectReason, Score);
+		});
+	}
+
+	// Get the closest one to current target we can line trace to
+	AActor* ActorToTarget = nullptr;
+	{
+		TargetSystem::FScopedQueryTimer ScoreTimer(LastQueryStats.ScoreTime, bIsRecordingQuery);
+
+		const FVector CurrentTargetLocation = CurrentTarget->GetActorLocation();
+		for (FSideCandidate& Candidate : Candidates)
+		{
+			Candidate.Distance = FVector::Dist(CurrentTargetLocation, Candidate.Location);
+		}
+
+		Candidates.Sort([](const FSideCandidate& A, const FSideCandidate& B)
+		{
+			return A.Distance < B.Distance;
+		});
+
+		TArray<AActor*> ActorsToIgnore;
+		ActorsToIgnore.Add(CurrentTarget);
+		for (const FSideCandidate& Candidate : Candidates)
+		{
+			if (Candidate.Distance >= ClosestTargetDistance)
+			{
+				RecordCandidate(Candidate.Actor, ETargetSystemRejectReason::OutOfRange, Candidate.Distance);
+			}
+			else if (!HasLineOfSightToCandidate(Candidate.Actor, Candidate.Location, ActorsToIgnore))
+			{
+				RecordCandidate(Candidate.Actor, ETargetSystemRejectReason::Occluded, Candidate.Distance);
+			}
+			else
+			{
+				RecordCandidate(Candidate.Actor, ETargetSystemRejectReason::None, Candidate.Distance);
+				ClosestTargetDistance = Candidate.Distance;
+				ActorToTarget = Candidate.Actor;
+				break;
+			}
+		}
+	}
+
+	return ActorToTarget;
+}
+
+bool UTargetSystemComponent::ShouldUseScreenGrid() const
+{
+	const UWorld* World = GetWorld();
+	return SelectionMode == ETargetSystemSelectionMode::ClosestToCrosshair
+		&& IsValid(OwnerPlayerController)
+		&& World && World->GetGameViewport();
+}
+
+void UTargetSystemComponent::UpdateScreenGrid()
+{
+	// Built once per frame, and shared by every query of the frame
+	if (ScreenGrid.IsBuiltForFrame(GFrameCounter))
+	{
+		return;
+	}
+
+	TArray<AActor*> Actors;
+	{
+		TargetSystem::FScopedQueryTimer GatherTimer(LastQueryStats.GatherTime, bIsRecordingQuery);
+		Actors = GatherCandidates();
+	}
+
+	TargetSystem::FScopedQueryTimer FilterTimer(LastQueryStats.FilterTime, bIsRecordingQuery);
+
+	FVector2D ViewportSize;
+	GetWorld()->GetGameViewport()->GetViewportSize(ViewportSize);
+
+	TArray<FTargetSystemScreenGrid::FEntry> Entries;
+	Entries.Reserve(Actors.Num());
+
+	for (AActor* Actor : Actors)
+	{
+		const float Distance = GetDistanceFromCharacter(Actor);
+		if (Distance >= MinimumDistanceToEnable)
+		{
+			RecordCandidate(Actor, ETargetSystemRejectReason::OutOfRange, Distance);
+			continue;
+		}
+
+		bool bIsOnScreen = false;
+		const TConstArrayView<FTargetSystemLockPoint> LockPoints = GetLockPoints(Actor);
+		for (int32 LockPointIndex = 0; LockPointIndex < LockPoints.Num(); LockPointIndex++)
+		{
+			const FTargetSystemLockPoint& LockPoint = LockPoints[LockPointIndex];
+			const USceneComponent* Component = UTargetSystemSubsystem::FindLockPointComponent(Actor, LockPoint);
+			const FVector Location = UTargetSystemSubsystem::GetLockPointLocation(Actor, Component, LockPoint);
+
+			FVector2D ScreenLocation;
+			if (!OwnerPlayerController->ProjectWorldLocationToScreen(Location, ScreenLocation))
+			{
+				continue;
+			}
+
+			if (ScreenLocation.X > 0 && ScreenLocation.Y > 0 && ScreenLocation.X < ViewportSize.X && ScreenLocation.Y < ViewportSize.Y)
+			{
+				Entries.Add({ Actor, LockPointIndex, Location, ScreenLocation });
+				bIsOnScreen = true;
+			}
+		}
+
+		if (!bIsOnScreen)
+		{
+			RecordCandidate(Actor, ETargetSystemRejectReason::OffScreen, Distance);
+		}
+	}
+
+	ScreenGrid.Build(ViewportSize, MoveTemp(Entries), ViewportSize.Y / TargetSystem::ScreenGridRows, GFrameCounter);
+}
+
+AActor* UTargetSystemComponent::FindTargetClosestToCrosshair(int32& OutLockPointIndex)
+{
+	OutLockPointIndex = 0;
+	UpdateScreenGrid();
+
+	TargetSystem::FScopedQueryTimer ScoreTimer(LastQueryStats.ScoreTime, bIsRecordingQuery);
+
+	const FVector2D ViewportSize = ScreenGrid.GetViewportSize();
+	const FVector2D Crosshair = CrosshairScreenLocation * ViewportSize;
+	const float MaxDistance = CrosshairSelectionRadius * ViewportSize.Y;
+
+	const TArray<FTargetSystemScreenGrid::FEntry>& Entries = ScreenGrid.GetEntries();
+	TBitArray<> ExcludedEntries(false, Entries.Num());
+	const TArray<AActor*> ActorsToIgnore;
+
+	// Nearest lock point to the crosshair first, falling back to the next nearest one while occluded
+	while (true)
+	{
+		const int32 Index = ScreenGrid.FindNearest(Crosshair, MaxDistance, ExcludedEntries);
+		if (Index == INDEX_NONE)
+		{
+			return nullptr;
+		}
+
+		const FTargetSystemScreenGrid::FEntry& Entry = Entries[Index];
+		if (!IsValid(Entry.Actor))
+		{
+			// Destroyed since the grid was built earlier this frame
+			ExcludedEntries[Index] = true;
+			continue;
+		}
+
+		const float Score = FVector2D::Distance(Crosshair, Entry.ScreenLocation);
+		if (HasLineOfSightToCandidate(Entry.Actor, Entry.WorldLocation, ActorsToIgnore))
+		{
+			RecordCandidate(Entry.Actor, ETargetSystemRejectReason::None, Score);
+			OutLockPointIndex = Entry.LockPointIndex;
+			return Entry.Actor;
+		}
+
+		RecordCandidate(Entry.Actor, ETargetSystemRejectReason::Occluded, Score);
+		ExcludedEntries[Index] = true;
+	}
+}
+
+AActor* UTargetSystemComponent::FindTargetInScreenDirection(AActor* CurrentTarget, const FVector2D& Direction, int32& OutLockPointIndex)
+{
+	OutLockPointIndex = 0;
+	UpdateScreenGrid();
+
+	TargetSystem::FScopedQueryTimer ScoreTimer(LastQueryStats.ScoreTime, bIsRecordingQuery);
+
+	// Search from the locked on point, or the crosshair if it is behind the camera
+	FVector2D Origin;
+	if (!OwnerPlayerController->ProjectWorldLocationToScreen(GetLockedOnLocation(), Origin))
+	{
+		Origin = CrosshairScreenLocation * ScreenGrid.GetViewportSize();
+	}
+
+	const TArray<FTargetSystemScreenGrid::FEntry>& Entries = ScreenGrid.GetEntries();
+	TBitArray<> ExcludedEntries(false, Entries.Num());
+	for (int32 Index = 0; Index < Entries.Num(); Index++)
+	{
+		ExcludedEntries[Index] = Entries[Index].Actor == CurrentTarget;
+	}
+
+	TArray<AActor*> ActorsToIgnore;
+	ActorsToIgnore.Add(CurrentTarget);
+
+	while (true)
+	{
+		const int32 Index = ScreenGrid.FindInDirection(Origin, Direction, MaxScreenSwitchAngle, ExcludedEntries);
+		if (Index == INDEX_NONE)
+		{
+			return nullptr;
+		}
+
+		const FTargetSystemScreenGrid::FEntry& Entry = Entries[Index];
+		if (!IsValid(Entry.Actor))
+		{
+			// Destroyed since the grid was built earlier this frame
+			ExcludedEntries[Index] = true;
+			continue;
+		}
+
+		const float Score = FVector2D::Distance(Origin, Entry.ScreenLocation);
+		if (HasLineOfSightToCandidate(Entry.Actor, Entry.WorldLocation, ActorsToIgnore))
+		{
+			RecordCandidate(Entry.Actor, ETargetSystemRejectReason::None, Score);
+			OutLockPointIndex = Entry.LockPointIndex;
+			return Entry.Actor;
+		}
+
+		RecordCandidate(Entry.Actor, ETargetSystemRejectReason::Occluded, Score);
+		ExcludedEntries[Index] = true;
+	}
+}
+
+bool UTargetSystemComponent::GetTargetLockedStatus()
+{
+	return bTargetLocked;
+}
+
+AActor* UTargetSystemComponent::GetLockedOnTargetActor() const
+{
+	return LockedOnTargetActor;
+}
+
+bool UTargetSystemComponent::IsLocked() const
+{
+	return bTargetLocked && LockedOnTargetActor;
+}
+
+const FTargetSystemQueryStats& UTargetSystemComponent::GetLastQueryStats() const
+{
+	// Keeps the stats recorded for as long as someone (the Gameplay Debugger category) is reading them
+	LastQueryStatsReadTime = FPlatformTime::Seconds();
+	return LastQueryStats;
+}
+
+int32 UTargetSystemComponent::GetNumLineOfSightTracesAvoided() const
+{
+	return NumLineOfSightTracesAvoided;
+}
+
+const FTargetSystemRecentTargets& UTargetSystemComponent::GetRecentTargets() const
+{
+	return RecentTargets;
+}
+
+void UTargetSystemComponent::MultiLockOn()
+{
+	if (bIsMultiLocked)
+	{
+		return;
+	}
+
+	// Recast PlayerController in case it wasn't already setup on Begin Play (local split screen)
+	SetupLocalPlayerController();
+
+	bIsMultiLocked = true;
+	LockedOnTargetSlots.Init(nullptr, FMath::Max(MaxLockedTargets, 1));
+
+	if (!MultiLockState)
+	{
+		MultiLockState = MakeShared<FTargetSystemMultiLockState>();
+	}
+
+	UpdateMultiLock();
+	UpdateTickEnabled();
+}
+
+void UTargetSystemComponent::MultiLockOff()
+{
+	if (!bIsMultiLocked)
+	{
+		return;
+	}
+
+	bIsMultiLocked = false;
+	for (int32 SlotIndex = 0; SlotIndex < LockedOnTargetSlots.Num(); SlotIndex++)
+	{
+		ReleaseTargetSlot(SlotIndex);
+	}
+
+	// Ignore traces still in flight, and gather candidates again on the next MultiLockOn()
+	MultiLockState->Heap.Reset();
+	MultiLockState->Distances.Reset();
+	MultiLockState->Batch.Reset();
+	MultiLockState->NextRescanTime = 0.0;
+	MultiLockState->NumPendingTraces = 0;
+	MultiLockState->BatchId++;
+
+	LockedOnTargetSlots.Reset();
+	UpdateTickEnabled();
+}
+
+bool UTargetSystemComponent::IsMultiLocked() const
+{
+	return bIsMultiLocked;
+}
+
+TArray<AActor*> UTargetSystemComponent::GetMultiLockedTargets() const
+{
+	return LockedOnTargetSlots;
+}
+
+void UTargetSystemComponent::UpdateMultiLock()
+{
+	const UWorld* World = GetWorld();
+	if (!IsValid(World) || !IsValid(OwnerActor))
+	{
+		return;
+	}
+
+	NextMultiLockUpdateTime = World->GetTimeSeconds() + MultiLockUpdateInterval;
+
+	// Previous update is still waiting on its traces
+	FTargetSystemMultiLockState& State = *MultiLockState;
+	if (State.NumPendingTraces > 0)
+	{
+		return;
+	}
+
+	// Gathering is what scales with the number of actors in the world, so the heap is only rebuilt from time to time.
+	// In between, only the candidates that moved are pushed again, without rebuilding the heap.
+	if (World->GetTimeSeconds() >= State.NextRescanTime)
+	{
+		State.NextRescanTime = World->GetTimeSeconds() + MultiLockRescanInterval;
+		State.Heap.Reset();
+		State.Distances.Reset();
+		for (AActor* Actor : GatherCandidates())
+		{
+			const float Distance = GetDistanceFromCharacter(Actor);
+			State.Heap.Add({ Actor, Distance });
+			State.Distances.Add(Actor, Distance);
+		}
+
+		State.Heap.Heapify();
+	}
+	else
+	{
+		for (TMap<TObjectKey<AActor>, float>::TIterator It = State.Distances.CreateIterator(); It; ++It)
+		{
+			AActor* Actor = It.Key().ResolveObjectPtr();
+			if (!IsValid(Actor))
+			{
+				It.RemoveCurrent();
+				continue;
+			}
+
+			const float Distance = GetDistanceFromCharacter(Actor);
+			if (FMath::Abs(Distance - It.Value()) > TargetSystem::MultiLockRescoreTolerance)
+			{
+				It.Value() = Distance;
+				State.Heap.HeapPush({ Actor, Distance });
+			}
+		}
+
+		// Rebuilt once stale entries outnumber the current ones
+		if (State.Heap.Num() > 2 * State.Distances.Num())
+		{
+			State.Heap.Reset();
+			for (const TPair<TObjectKey<AActor>, float>& Pair : State.Distances)
+			{
+				State.Heap.Add({ Pair.Key.ResolveObjectPtr(), Pair.Value });
+			}
+
+			State.Heap.Heapify();
+		}
+	}
+
+	State.Batch.Reset();
+	State.BatchId++;
+
+	IssueMultiLockTraces();
+}
+
+void UTargetSystemComponent::IssueMultiLockTraces()
+{
+	UWorld* World = GetWorld();
+	if (!IsValid(World) || !IsValid(OwnerActor))
+	{
+		return;
+	}
+
+	FTargetSystemMultiLockState& State = *MultiLockState;
+	const FCollisionQueryParams Params = MakeLineTraceParams(TArray<AActor*>());
+	const FTraceDelegate TraceDelegate = FTraceDelegate::CreateUObject(this, &UTargetSystemComponent::OnMultiLockTraceCompleted, State.BatchId);
+	const FVector Start = OwnerActor->GetActorLocation();
+	const int32 NumSamples = FMath::Max(VisibilitySamples.Num(), 1);
+	const int32 NumSlots = LockedOnTargetSlots.Num();
+
+	// Traces the next visibility sample of a candidate not traced yet, returning false once every sample was tested
+	const auto TraceNextSample = [&](TargetSystem::FAsyncCandidate& Candidate, const int32 BatchIndex)
+	{
+		FVector SampleLocation;
+		bool bHasSample = false;
+		TargetSystem::FVisibilitySampler Sampler(Candidate.Actor.Get(), Candidate.Actor->GetActorLocation());
+		while (!bHasSample && Candidate.NumSamplesTested < NumSamples)
+		{
+			bHasSample = Sampler.GetLocation(GetVisibilitySample(Candidate.NumSamplesTested++), SampleLocation)
+				&& !Candidate.TracedLocations.ContainsByPredicate([&SampleLocation](const FVector& Location)
+				{
+					return Location.Equals(SampleLocation, 1.0f);
+				});
+		}
+
+		if (!bHasSample)
+		{
+			return false;
+		}
+
+		Candidate.TracedLocations.Add(SampleLocation);
+		World->AsyncLineTraceByChannel(
+			EAsyncTraceType::Single,
+			Start,
+			SampleLocation,
+			TargetableCollisionChannel,
+			Params,
+			FCollisionResponseParams::DefaultResponseParam,
+			&TraceDelegate,
+			BatchIndex
+		);
+
+		State.NumPendingTraces++;
+		return true;
+	};
+
+	// Like IssueAsyncTraces(), traces are issued in rounds of one visibility sample per candidate, and a candidate is
+	// no longer traced once one of its samples hits. Only the nearest candidates that could still fill a slot (visible
+	// or not decided yet) are traced, more being popped from the heap for the slots left free by occluded ones.
+	int32 NumSelectable = 0;
+	for (int32 BatchIndex = 0; BatchIndex < State.Batch.Num() && NumSelectable < NumSlots; BatchIndex++)
+	{
+		TargetSystem::FAsyncCandidate& Candidate = State.Batch[BatchIndex];
+		if (Candidate.bTraceHit)
+		{
+			NumSelectable++;
+		}
+		else if (Candidate.RejectReason == ETargetSystemRejectReason::None && IsValid(Candidate.Actor.Get()))
+		{
+			if (TraceNextSample(Candidate, BatchIndex))
+			{
+				NumSelectable++;
+			}
+			else
+			{
+				Candidate.RejectReason = ETargetSystemRejectReason::Occluded;
+			}
+		}
+	}
+
+	while (NumSelectable < NumSlots && State.Heap.Num() > 0)
+	{
+		TargetSystem::FMultiLockCandidate Candidate;
+		State.Heap.HeapPop(Candidate);
+
+		// Stale entry, the candidate moved and was pushed again since
+		AActor* Actor = Candidate.Actor.Get();
+		const float* Distance = IsValid(Actor) ? State.Distances.Find(Actor) : nullptr;
+		if (!Distance || *Distance != Candidate.Distance)
+		{
+			continue;
+		}
+
+		const int32 BatchIndex = State.Batch.Num();
+		TargetSystem::FAsyncCandidate& BatchCandidate = State.Batch.AddDefaulted_GetRef();
+		BatchCandidate.Actor = Actor;
+		BatchCandidate.Distance = Candidate.Distance;
+
+		// Nearest first, every remaining candidate is out of range as well
+		if (Candidate.Distance >= MinimumDistanceToEnable)
+		{
+			BatchCandidate.RejectReason = ETargetSystemRejectReason::OutOfRange;
+			break;
+		}
+
+		if (!TargetIsTargetable(Actor))
+		{
+			BatchCandidate.RejectReason = ETargetSystemRejectReason::NotTargetable;
+			continue;
+		}
+
+		if (!IsInViewport(Actor))
+		{
+			BatchCandidate.RejectReason = ETargetSystemRejectReason::OffScreen;
+			continue;
+		}
+
+		if (SightConfirmedCandidates.Contains(Actor))
+		{
+			BatchCandidate.bTraceHit = true;
+			NumSelectable++;
+			continue;
+		}
+
+		if (TraceNextSample(BatchCandidate, BatchIndex))
+		{
+			NumSelectable++;
+		}
+		else
+		{
+			BatchCandidate.RejectReason = ETargetSystemRejectReason::Occluded;
+		}
+	}
+
+	if (State.NumPendingTraces == 0)
+	{
+		ApplyMultiLockSelection();
+	}
+}
+
+void UTargetSystemComponent::OnMultiLockTraceCompleted(const FTraceHandle& TraceHandle, FTraceDatum& TraceDatum, const uint32 BatchId)
+{
+	if (!bIsMultiLocked || !MultiLockState || MultiLockState->BatchId != BatchId)
+	{
+		return;
+	}
+
+	FTargetSystemMultiLockState& State = *MultiLockState;
+	if (!State.Batch.IsValidIndex(TraceDatum.UserData))
+	{
+		return;
+	}
+
+	TargetSystem::FAsyncCandidate& Candidate = State.Batch[TraceDatum.UserData];
+	Candidate.bTraceHit = Candidate.bTraceHit || (TraceDatum.OutHits.Num() > 0 && TraceDatum.OutHits[0].GetActor() == Candidate.Actor.Get());
+
+	// Next round once every trace of the current one completed, applying the selection when there is nothing left to trace
+	State.NumPendingTraces--;
+	if (State.NumPendingTraces == 0)
+	{
+		IssueMultiLockTraces();
+	}
+}
+
+void UTargetSystemComponent::ApplyMultiLockSelection()
+{
+	FTargetSystemMultiLockState& State = *MultiLockState;
+	const int32 NumSlots = LockedOnTargetSlots.Num();
+
+	TArray<AActor*, TInlineAllocator<8>> SelectedTargets;
+	for (const TargetSystem::FAsyncCandidate& Candidate : State.Batch)
+	{
+		AActor* Actor = Candidate.Actor.Get();
+		if (Candidate.bTraceHit && IsValid(Actor) && SelectedTargets.Num() < NumSlots)
+		{
+			SelectedTargets.Add(Actor);
+		}
+
+		// Back in the heap for the next update, unless the candidate is gone
+		if (IsValid(Actor) && State.Distances.Contains(Actor))
+		{
+			State.Heap.HeapPush({ Candidate.Actor, Candidate.Distance });
+		}
+	}
+
+	State.Batch.Reset();
+
+	// Release slots whose target is no longer selected first, so that freed slots can be reused below
+	for (int32 SlotIndex = 0; SlotIndex < NumSlots; SlotIndex++)
+	{
+		if (LockedOnTargetSlots[SlotIndex] && !SelectedTargets.Contains(LockedOnTargetSlots[SlotIndex]))
+		{
+			ReleaseTargetSlot(SlotIndex);
+		}
+	}
+
+	for (AActor* Target : SelectedTargets)
+	{
+		if (LockedOnTargetSlots.Contains(Target))
+		{
+			continue;
+		}
+
+		const int32 SlotIndex = LockedOnTargetSlots.Find(nullptr);
+		if (SlotIndex == INDEX_NONE)
+		{
+			break;
+		}
+
+		LockedOnTargetSlots[SlotIndex] = Target;
+		OnTargetSlotLockedOn.Broadcast(Target, SlotIndex);
+	}
+}
+
+void UTargetSystemComponent::ReleaseTargetSlot(const int32 SlotIndex)
+{
+	AActor* Target = LockedOnTargetSlots[SlotIndex];
+	if (!Target)
+	{
+		return;
+	}
+
+	LockedOnTargetSlots[SlotIndex] = nullptr;
+	OnTargetSlotLockedOff.Broadcast(Target, SlotIndex);
+}
+
+void UTargetSystemComponent::UpdateTickEnabled()
+{
+	SetComponentTickEnabled((bTargetLocked || bIsMultiLocked) && CanRunLocalTargeting());
+}
+
+void UTargetSystemComponent::ServerRequestLockOn_Implementation(AActor* TargetToLockOn, const uint8 LockPointIndex)
+{
+	TGuardValue<bool> NetworkLockGuard(bIsHandlingNetworkLock, true);
+
+	if (!IsValidServerLockOn(TargetToLockOn, LockPointIndex))
+	{
+		ClientLockOff(TargetToLockOn);
+		return;
+	}
+
+	// Stepping to another lock point of the same target
+	if (bTargetLocked && LockedOnTargetActor == TargetToLockOn)
+	{
+		SetLockedOnPoint(LockPointIndex);
+		OnLocalLockChanged(nullptr);
+		return;
+	}
+
+	if (bTargetLocked)
+	{
+		TargetLockOff();
+	}
+
+	TargetLockOn(TargetToLockOn, LockPointIndex);
+}
+
+void UTargetSystemComponent::ServerRequestLockOff_Implementation()
+{
+	TGuardValue<bool> NetworkLockGuard(bIsHandlingNetworkLock, true);
+	TargetLockOff();
+}
+
+void UTargetSystemComponent::ClientLockOff_Implementation(AActor* TargetToLockOff)
+{
+	// A newer predicted lock on another target is pending, the server will answer for it separately
+	if (!bTargetLocked || LockedOnTargetActor != TargetToLockOff)
+	{
+		return;
+	}
+
+	TGuardValue<bool> NetworkLockGuard(bIsHandlingNetworkLock, true);
+	TargetLockOff();
+}
+
+void UTargetSystemComponent::OnRep_ReplicatedLock()
+{
+	TGuardValue<bool> NetworkLockGuard(bIsHandlingNetworkLock, true);
+
+	if (!ReplicatedLock.bIsLocked || !IsValid(ReplicatedLock.Target))
+	{
+		if (bTargetLocked)
+		{
+			TargetLockOff();
+		}
+
+		return;
+	}
+
+	if (bTargetLocked && LockedOnTargetActor == ReplicatedLock.Target)
+	{
+		SetLockedOnPoint(ReplicatedLock.LockPointIndex);
+		return;
+	}
+
+	if (bTargetLocked)
+	{
+		TargetLockOff();
+	}
+
+	TargetLockOn(ReplicatedLock.Target, ReplicatedLock.LockPointIndex);
+}
+
+bool UTargetSystemComponent::IsValidServerLockOn(const AActor* TargetToLockOn, const int32 LockPointIndex) const
+{
+	if (!IsValid(TargetToLockOn) || !IsValid(OwnerActor) || !TargetIsTargetable(TargetToLockOn))
+	{
+		return false;
+	}
+
+	if (GetDistanceFromCharacter(TargetToLockOn) > MinimumDistanceToEnable + ServerLockOnDistanceTolerance)
+	{
+		return false;
+	}
+
+	// Traced to the requested lock point, which may be visible while the actor location is behind cover
+	const TConstArrayView<FTargetSystemLockPoint> LockPoints = GetLockPoints(TargetToLockOn);
+	if (!LockPoints.IsValidIndex(LockPointIndex))
+	{
+		return false;
+	}
+
+	const FTargetSystemLockPoint& LockPoint = LockPoints[LockPointIndex];
+	const FVector Location = UTargetSystemSubsystem::GetLockPointLocation(TargetToLockOn, UTargetSystemSubsystem::FindLockPointComponent(TargetToLockOn, LockPoint), LockPoint);
+
+	const TArray<AActor*> ActorsToIgnore;
+	return LineTraceForActor(TargetToLockOn, Location, ActorsToIgnore);
+}
+
+void UTargetSystemComponent::OnLocalLockChanged(AActor* PreviousTarget)
+{
+	if (GetOwnerRole() == ROLE_Authority)
+	{
+		FTargetSystemReplicatedLock NewLock;
+		NewLock.bIsLocked = bTargetLocked && LockedOnTargetActor;
+		NewLock.Target = NewLock.bIsLocked ? LockedOnTargetActor : nullptr;
+		NewLock.LockPointIndex = static_cast<uint8>(FMath::Clamp<int32>(LockedOnPointIndex, 0, FTargetSystemReplicatedLock::MaxLockPointIndex));
+
+		if (NewLock != ReplicatedLock)
+		{
+			ReplicatedLock = NewLock;
+			MARK_PROPERTY_DIRTY_FROM_NAME(UTargetSystemComponent, ReplicatedLock, this);
+		}
+
+		// Server released the lock on its own (out of range, line of sight, ...), tell the owning client
+		if (PreviousTarget && !bTargetLocked && !bIsHandlingNetworkLock && !IsOwnerLocallyControlled())
+		{
+			ClientLockOff(PreviousTarget);
+		}
+
+		return;
+	}
+
+	// Owning client predicts the lock change, and lets the server confirm or reject it
+	if (!bIsHandlingNetworkLock && IsOwnerLocallyControlled())
+	{
+		if (bTargetLocked && LockedOnTargetActor)
+		{
+			ServerRequestLockOn(LockedOnTargetActor, static_cast<uint8>(FMath::Clamp<int32>(LockedOnPointIndex, 0, FTargetSystemReplicatedLock::MaxLockPointIndex)));
+		}
+		else if (PreviousTarget)
+		{
+			ServerRequestLockOff();
+		}
+	}
+}
+
+bool UTargetSystemComponent::IsOwnerLocallyControlled() const
+{
+	return IsValid(OwnerPawn) && OwnerPawn->IsLocallyControlled();
+}
+
+bool UTargetSystemComponent::CanRunLocalTargeting() const
+{
+	return GetOwnerRole() == ROLE_Authority || IsOwnerLocallyControlled();
+}
+
+void UTargetSystemComponent::ResetIsSwitchingTarget()
+{
+	bIsSwitchingTarget = false;
+	bDesireToSwitch = false;
+}
+
+bool UTargetSystemComponent::ShouldSwitchTargetActor(const float AxisValue)
+{
+	// Sticky feeling computation
+	if (bEnableStickyTarget)
+	{
+		StartRotatingStack += (AxisValue != 0) ? AxisValue * AxisMultiplier : (StartRotatingStack > 0 ? -AxisMultiplier : AxisMultiplier);
+
+		if (AxisValue == 0 && FMath::Abs(StartRotatingStack) <= AxisMultiplier)
+		{
+			StartRotatingStack = 0.0f;
+		}
+
+		// If Axis value does not exceeds configured threshold, do nothing
+		if (FMath::Abs(StartRotatingStack) < StickyRotationThreshold)
+		{
+			bDesireToSwitch = false;
+			return false;
+		}
+
+		//Sticky when switching target.
+		if (StartRotatingStack * AxisValue > 0)
+		{
+			StartRotatingStack = StartRotatingStack > 0 ? StickyRotationThreshold : -StickyRotationThreshold;
+		}
+		else if (StartRotatingStack * AxisValue < 0)
+		{
+			StartRotatingStack = StartRotatingStack * -1.0f;
+		}
+
+		bDesireToSwitch = true;
+
+		return true;
+	}
+
+	// Non Sticky feeling, check Axis value exceeds threshold
+	return FMath::Abs(AxisValue) > StartRotatingThreshold;
+}
+
+bool UTargetSystemComponent::ShouldSwitchTargetActorWithStick(const FVector2D& StickInput)
+{
+	// Sticky feeling computation, the stack being a 2D vector instead of a signed value
+	if (bEnableStickyTarget)
+	{
+		if (!StickInput.IsZero())
+		{
+			StickRotatingStack += StickInput * AxisMultiplier;
+		}
+		else
+		{
+			const float StackSize = StickRotatingStack.Size();
+			StickRotatingStack = StackSize <= AxisMultiplier ? FVector2D::ZeroVector : StickRotatingStack * ((StackSize - AxisMultiplier) / StackSize);
+		}
+
+		// If the stack does not exceed configured threshold, do nothing
+		if (StickRotatingStack.Size() < StickyRotationThreshold || StickInput.IsZero())
+		{
+			bDesireToSwitch = false;
+			return false;
+		}
+
+		// Sticky when switching target, in the direction the stick is pushed
+		StickRotatingStack = StickInput.GetSafeNormal() * StickyRotationThreshold;
+		bDesireToSwitch = true;
+
+		return true;
+	}
+
+	// Non Sticky feeling, check stick magnitude exceeds threshold
+	return StickInput.Size() > StartRotatingThreshold;
+}
+
+void UTargetSystemComponent::TargetLockOn(AActor* TargetToLockOn, const int32 LockPointIndex)
+{
+	if (!IsValid(TargetToLockOn))
+	{
+		return;
+	}
+
+	// Recast PlayerController in case it wasn't already setup on Begin Play (local split screen)
+	SetupLocalPlayerController();
+
+	LockedOnTargetActor = TargetToLockOn;
+	bTargetLocked = true;
+	RecentTargets.Remove(TargetToLockOn);
+	BindToLockedOnTarget(TargetToLockOn);
+	SetLockedOnPoint(LockPointIndex);
+	OnLocalLockChanged(nullptr);
+
+	if (bShouldDrawLockedOnWidget && IsOwnerLocallyControlled())
+	{
+		CreateAndAttachTargetLockedOnWidgetComponent(TargetToLockOn);
+	}
+
+	if (bShouldControlRotation)
+	{
+		ControlRotation(true);
+	}
+
+	if (bAdjustPitchBasedOnDistanceToTarget || bIgnoreLookInput)
+	{
+		if (IsValid(OwnerPlayerController))
+		{
+			OwnerPlayerController->SetIgnoreLookInput(true);
+		}
+	}
+
+	if (OnTargetLockedOn.IsBound())
+	{
+		OnTargetLockedOn.Broadcast(TargetToLockOn);
+	}
+}
+
+void UTargetSystemComponent::TargetLockOff()
+{
+	// Recast PlayerController in case it wasn't already setup on Begin Play (local split screen)
+	SetupLocalPlayerController();
+
+	CompleteAsyncQuery(nullptr);
+	GetWorld()->GetTimerManager().ClearTimer(RegainSightTimerHandle);
+
+	// Remembered before anything is reset, so that it can be locked back on cheaply
+	if (IsValid(LockedOnTargetActor))
+	{
+		RecentTargets.SetCapacity(MaxRecentTargets);
+		RecentTargets.Add(LockedOnTargetActor, LockedOnPointIndex, GetLockedOnLocation(), GetWorld()->GetTimeSeconds());
+	}
+
+	bTargetLocked = false;
+	UnbindFromLockedOnTarget();
+
+	if (TargetLockedOnWidgetComponent)
+	{
+		TargetLockedOnWidgetComponent->DestroyComponent();
 	}
 
 	if (LockedOnTargetActor)
@@ -376,51 +1801,324 @@ void UTargetSystemComponent::TargetLockOff()
 		}
 	}
 
-	LockedOnTargetActor = nullptr;
+	AActor* PreviousTarget = LockedOnTargetActor;
+	LockedOnTargetActor = nullptr;
+	LockedOnPointIndex = 0;
+	LockedOnPoint = FTargetSystemLockPoint();
+	LockedOnPointComponent.Reset();
+
+	OnLocalLockChanged(PreviousTarget);
+}
+
+void UTargetSystemComponent::SwitchLockPoint(const int32 Direction)
+{
+	if (!IsLocked())
+	{
+		return;
+	}
+
+	const int32 NumLockPoints = GetLockPoints(LockedOnTargetActor).Num();
+	if (NumLockPoints <= 1)
+	{
+		return;
+	}
+
+	const int32 Step = Direction < 0 ? -1 : 1;
+	SetLockedOnPoint((LockedOnPointIndex + Step + NumLockPoints) % NumLockPoints);
+
+	// Stays where it is if the component of the new lock point can't be found
+	if (TargetLockedOnWidgetComponent && !LockedOnPoint.IsDefault() && LockedOnPointComponent.IsValid())
+	{
+		TargetLockedOnWidgetComponent->AttachToComponent(LockedOnPointComponent.Get(), FAttachmentTransformRules::KeepRelativeTransform, LockedOnPoint.SocketName);
+	}
+
+	OnLocalLockChanged(nullptr);
+	OnTargetLockPointChanged.Broadcast(LockedOnTargetActor, LockedOnPointIndex);
+}
+
+int32 UTargetSystemComponent::GetLockedOnPointIndex() const
+{
+	return LockedOnPointIndex;
+}
+
+FVector UTargetSystemComponent::GetLockedOnLocation() const
+{
+	if (!LockedOnTargetActor)
+	{
+		return FVector::ZeroVector;
+	}
+
+	return UTargetSystemSubsystem::GetLockPointLocation(LockedOnTargetActor, LockedOnPointComponent.Get(), LockedOnPoint);
+}
+
+TConstArrayView<FTargetSystemLockPoint> UTargetSystemComponent::GetLockPoints(const AActor* Actor) const
+{
+	if (UTargetSystemSubsystem* Subsystem = GetWorld()->GetSubsystem<UTargetSystemSubsystem>())
+	{
+		return Subsystem->GetLockPoints(Actor);
+	}
+
+	static const FTargetSystemLockPoint DefaultLockPoint;
+	return TConstArrayView<FTargetSystemLockPoint>(&DefaultLockPoint, 1);
+}
+
+void UTargetSystemComponent::SetLockedOnPoint(const int32 LockPointIndex)
+{
+	const TConstArrayView<FTargetSystemLockPoint> LockPoints = GetLockPoints(LockedOnTargetActor);
+
+	LockedOnPointIndex = LockPoints.IsValidIndex(LockPointIndex) ? LockPointIndex : 0;
+	LockedOnPoint = LockPoints[LockedOnPointIndex];
+	LockedOnPointComponent = UTargetSystemSubsystem::FindLockPointComponent(LockedOnTargetActor, LockedOnPoint);
+}
+
+void UTargetSystemComponent::CreateAndAttachTargetLockedOnWidgetComponent(AActor* TargetActor)
+{
+	if (!LockedOnWidgetClass)
+	{
+		TS_LOG(Error, TEXT("TargetSystemComponent: Cannot get LockedOnWidgetClass, please ensure it is a valid reference in the Component Properties."));
+		return;
+	}
+
+	TargetLockedOnWidgetComponent = NewObject<UWidgetComponent>(TargetActor, MakeUniqueObjectName(TargetActor, UWidgetComponent::StaticClass(), FName("TargetLockOn")));
+	TargetLockedOnWidgetComponent->SetWidgetClass(LockedOnWidgetClass);
+
+	UMeshComponent* MeshComponent = TargetActor->FindComponentByClass<UMeshComponent>();
+	USceneComponent* ParentComponent = MeshComponent && LockedOnWidgetParentSocket != NAME_None ? MeshComponent : TargetActor->GetRootComponent();
+	FName ParentSocket = LockedOnWidgetParentSocket;
+
+	// Explicit lock points replace LockedOnWidgetParentSocket
+	if (!LockedOnPoint.IsDefault() && LockedOnPointComponent.IsValid())
+	{
+		ParentComponent = LockedOnPointComponent.Get();
+		ParentSocket = LockedOnPoint.SocketName;
+	}
+
+	if (IsValid(OwnerPlayerController))
+	{
+		TargetLockedOnWidgetComponent->SetOwnerPlayer(OwnerPlayerController->GetLocalPlayer());
+	}
+
+	TargetLockedOnWidgetComponent->ComponentTags.Add(FName("TargetSystem.LockOnWidget"));
+	TargetLockedOnWidgetComponent->SetWidgetSpace(EWidgetSpace::Screen);
+	TargetLockedOnWidgetComponent->SetupAttachment(ParentComponent, ParentSocket);
+	TargetLockedOnWidgetComponent->SetRelativeLocation(LockedOnWidgetRelativeLocation);
+	TargetLockedOnWidgetComponent->SetDrawSize(FVector2D(LockedOnWidgetDrawSize, LockedOnWidgetDrawSize));
+	TargetLockedOnWidgetComponent->SetVisibility(true);
+	TargetLockedOnWidgetComponent->RegisterComponent();
+}
+
+TArray<AActor*> UTargetSystemComponent::GetAllActorsOfClass(const TSubclassOf<AActor> ActorClass) const
+{
+	TArray<AActor*> Actors;
+	for (TActorIterator<AActor> ActorIterator(GetWorld(), ActorClass); ActorIterator; ++ActorIterator)
+	{
+		AActor* Actor = *ActorIterator;
+		const bool bIsTargetable = TargetIsTargetable(Actor);
+		if (bIsTargetable)
+		{
+			Actors.Add(Actor);
+		}
+		else
+		{
+			RecordCandidate(Actor, ETargetSystemRejectReason::NotTargetable);
+		}
+	}
+
+	return Actors;
+}
+
+TArray<AActor*> UTargetSystemComponent::GetOverlappingActors(const TSubclassOf<AActor> ActorClass) const
+{
+	TArray<FOverlapResult> Overlaps;
+	const FCollisionQueryParams Params(FName("OverlapMultiByChannel"), false, OwnerActor);
+	GetWorld()->OverlapMultiByChannel(
+		Overlaps,
+		OwnerActor->GetActorLocation(),
+		FQuat::Identity,
+		TargetableCollisionChannel,
+		FCollisionShape::MakeSphere(MinimumDistanceToEnable),
+		Params
+	);
+
+	// Actors are returned once per overlapping component
+	TSet<const AActor*> UniqueActors;
+	UniqueActors.Reserve(Overlaps.Num());
+
+	TArray<AActor*> Actors;
+	Actors.Reserve(Overlaps.Num());
+	for (const FOverlapResult& Overlap : Overlaps)
+	{
+		AActor* Actor = Overlap.GetActor();
+		if (!IsValid(Actor) || (ActorClass && !Actor->IsA(ActorClass)))
+		{
+			continue;
+		}
+
+		bool bIsAlreadyInSet = false;
+		UniqueActors.Add(Actor, &bIsAlreadyInSet);
+		if (bIsAlreadyInSet)
+		{
+			continue;
+		}
+
+		if (TargetIsTargetable(Actor))
+		{
+			Actors.Add(Actor);
+		}
+		else
+		{
+			RecordCandidate(Actor, ETargetSystemRejectReason::NotTargetable);
+		}
+	}
+
+	return Actors;
+}
+
+TArray<AActor*> UTargetSystemComponent::GatherCandidates()
+{
+	SightConfirmedCandidates.Reset();
+
+	if (bIsRecordingQuery)
+	{
+		LastQueryStats.NumGathers++;
+	}
+
+	if (CandidateSource == ETargetSystemCandidateSource::AIPerception)
+	{
+		if (const UAIPerceptionComponent* PerceptionComponent = GetOwnerPerceptionComponent())
+		{
+			return GetPerceivedActors(PerceptionComponent);
+		}
+	}
+
+	if (CandidateSource == ETargetSystemCandidateSource::PhysicsOverlap)
+	{
+		return GetOverlappingActors(TargetableActors);
+	}
+
+	if (CandidateSource == ETargetSystemCandidateSource::Registry)
+	{
+		if (UTargetSystemSubsystem* Subsystem = GetWorld()->GetSubsystem<UTargetSystemSubsystem>())
+		{
+			return GetRegisteredActors(Subsystem);
+		}
+	}
+
+	return GetAllActorsOfClass(TargetableActors);
+}
+
+TArray<AActor*> UTargetSystemComponent::GetRegisteredActors(UTargetSystemSubsystem* Subsystem) const
+{
+	// No-op once registered, unless CandidateSource or TargetableActors changed at runtime
+	Subsystem->RegisterTargetableClass(TargetableActors);
+
+	TArray<AActor*> Actors;
+	Subsystem->ForEachRegisteredTarget([this, &Actors](AActor* Actor)
+	{
+		if (Actor == OwnerActor || (TargetableActors && !Actor->IsA(TargetableActors)))
+		{
+			return;
+		}
+
+		if (TargetIsTargetable(Actor))
+		{
+			Actors.Add(Actor);
+		}
+		else
+		{
+			RecordCandidate(Actor, ETargetSystemRejectReason::NotTargetable);
+		}
+	});
+
+	return Actors;
+}
+
+TArray<AActor*> UTargetSystemComponent::GetPerceivedActors(const UAIPerceptionComponent* PerceptionComponent)
+{
+	TArray<AActor*> PerceivedActors;
+	PerceptionComponent->GetCurrentlyPerceivedActors(nullptr, PerceivedActors);
+
+	const FAISenseID SightSenseID = UAISense::GetSenseID<UAISense_Sight>();
+
+	TArray<AActor*> Actors;
+	Actors.Reserve(PerceivedActors.Num());
+	for (AActor* Actor : PerceivedActors)
+	{
+		if (!IsValid(Actor) || Actor == OwnerActor || (TargetableActors && !Actor->IsA(TargetableActors)))
+		{
+			continue;
+		}
+
+		if (!TargetIsTargetable(Actor))
+		{
+			RecordCandidate(Actor, ETargetSystemRejectReason::NotTargetable);
+			continue;
+		}
+
+		Actors.Add(Actor);
+
+		// Sight already traced to this actor, no need to do it again
+		const FActorPerceptionInfo* PerceptionInfo = PerceptionComponent->GetActorInfo(*Actor);
+		if (PerceptionInfo && SightSenseID.IsValid() && PerceptionInfo->LastSensedStimuli.IsValidIndex(SightSenseID))
+		{
+			const FAIStimulus& Stimulus = PerceptionInfo->LastSensedStimuli[SightSenseID];
+			if (Stimulus.WasSuccessfullySensed() && Stimulus.GetAge() <= MaxSightStimulusAge)
+			{
+				SightConfirmedCandidates.Add(Actor);
+			}
+		}
+	}
+
+	return Actors;
 }
 
-void UTargetSystemComponent::CreateAndAttachTargetLockedOnWidgetComponent(AActor* TargetActor)
+UAIPerceptionComponent* UTargetSystemComponent::GetOwnerPerceptionComponent() const
 {
-	if (!LockedOnWidgetClass)
+	if (IsValid(OwnerPawn))
 	{
-		TS_LOG(Error, TEXT("TargetSystemComponent: Cannot get LockedOnWidgetClass, please ensure it is a valid reference in the Component Properties."));
-		return;
+		if (AAIController* AIController = Cast<AAIController>(OwnerPawn->GetController()))
+		{
+			if (UAIPerceptionComponent* PerceptionComponent = AIController->GetAIPerceptionComponent())
+			{
+				return PerceptionComponent;
+			}
+		}
 	}
 
-	TargetLockedOnWidgetComponent = NewObject<UWidgetComponent>(TargetActor, MakeUniqueObjectName(TargetActor, UWidgetComponent::StaticClass(), FName("TargetLockOn")));
-	TargetLockedOnWidgetComponent->SetWidgetClass(LockedOnWidgetClass);
-
-	UMeshComponent* MeshComponent = TargetActor->FindComponentByClass<UMeshComponent>();
-	USceneComponent* ParentComponent = MeshComponent && LockedOnWidgetParentSocket != NAME_None ? MeshComponent : TargetActor->GetRootComponent();
+	return IsValid(OwnerActor) ? OwnerActor->FindComponentByClass<UAIPerceptionComponent>() : nullptr;
+}
 
-	if (IsValid(OwnerPlayerController))
+bool UTargetSystemComponent::HasLineOfSightToCandidate(const AActor* Actor, const FVector& TargetLocation, const TArray<AActor*>& ActorsToIgnore) const
+{
+	if (SightConfirmedCandidates.Contains(Actor))
 	{
-		TargetLockedOnWidgetComponent->SetOwnerPlayer(OwnerPlayerController->GetLocalPlayer());
-	}
+		if (bIsRecordingQuery)
+		{
+			LastQueryStats.NumTracesAvoided++;
+		}
 
-	TargetLockedOnWidgetComponent->ComponentTags.Add(FName("TargetSystem.LockOnWidget"));
-	TargetLockedOnWidgetComponent->SetWidgetSpace(EWidgetSpace::Screen);
-	TargetLockedOnWidgetComponent->SetupAttachment(ParentComponent, LockedOnWidgetParentSocket);
-	TargetLockedOnWidgetComponent->SetRelativeLocation(LockedOnWidgetRelativeLocation);
-	TargetLockedOnWidgetComponent->SetDrawSize(FVector2D(LockedOnWidgetDrawSize, LockedOnWidgetDrawSize));
-	TargetLockedOnWidgetComponent->SetVisibility(true);
-	TargetLockedOnWidgetComponent->RegisterComponent();
-}
+		return true;
+	}
 
-TArray<AActor*> UTargetSystemComponent::GetAllActorsOfClass(const TSubclassOf<AActor> ActorClass) const
-{
-	TArray<AActor*> Actors;
-	for (TActorIterator<AActor> ActorIterator(GetWorld(), ActorClass); ActorIterator; ++ActorIterator)
+	// Not rendered for a while: either occluded, or off screen which callers reject anyway. Rendered ones may still be
+	// partially occluded, so they are traced.
+	if (ShouldUseRenderVisibility() && TargetSystem::GetRenderVisibility(GetWorld(), Actor, RenderVisibilityTolerance) == TargetSystem::ERenderVisibility::NotRendered)
 	{
-		AActor* Actor = *ActorIterator;
-		const bool bIsTargetable = TargetIsTargetable(Actor);
-		if (bIsTargetable)
+		if (bIsRecordingQuery)
 		{
-			Actors.Add(Actor);
+			LastQueryStats.NumTracesAvoided++;
 		}
+
+		return false;
 	}
 
-	return Actors;
+	return LineTraceForActor(Actor, TargetLocation, ActorsToIgnore);
+}
+
+bool UTargetSystemComponent::ShouldUseRenderVisibility() const
+{
+	// Render state is only updated on instances with a local view
+	return bUseRenderVisibility && IsValid(OwnerPlayerController) && OwnerPlayerController->IsLocalController();
 }
 
 bool UTargetSystemComponent::TargetIsTargetable(const AActor* Actor)
@@ -445,94 +2143,190 @@ void UTargetSystemComponent::SetupLocalPlayerController()
 	OwnerPlayerController = Cast<APlayerController>(OwnerPawn->GetController());
 }
 
-AActor* UTargetSystemComponent::FindNearestTarget(TArray<AActor*> Actors) const
+AActor* UTargetSystemComponent::FindNearestTarget(TArray<AActor*> Actors, int32& OutLockPointIndex) const
 {
-	TArray<AActor*> ActorsHit;
+	OutLockPointIndex = 0;
 
-	// Find all actors we can line trace to
-	for (AActor* Actor : Actors)
+	struct FLockPointCandidate
 	{
-		TArray<AActor*> ActorsToIgnore;
-		const bool bHit = LineTraceForActor(Actor, ActorsToIgnore);
-		if (bHit && IsInViewport(Actor))
+		AActor* Actor;
+		int32 LockPointIndex;
+		FVector Location;
+		float Distance;
+	};
+
+	// Every lock point of the actors in range, off screen ones being filtered out. Filtering and line traces are timed
+	// as in FindTargetAroundCharacter().
+	TArray<FLockPointCandidate> Candidates;
+	{
+		TargetSystem::FScopedQueryTimer FilterTimer(LastQueryStats.FilterTime, bIsRecordingQuery);
+
+		const FVector OwnerLocation = OwnerActor->GetActorLocation();
+		for (AActor* Actor : Actors)
 		{
-			ActorsHit.Add(Actor);
+			const float Distance = GetDistanceFromCharacter(Actor);
+			if (Distance >= ClosestTargetDistance)
+			{
+				RecordCandidate(Actor, ETargetSystemRejectReason::OutOfRange, Distance);
+				continue;
+			}
+
+			const TConstArrayView<FTargetSystemLockPoint> LockPoints = GetLockPoints(Actor);
+			for (int32 LockPointIndex = 0; LockPointIndex < LockPoints.Num(); LockPointIndex++)
+			{
+				const FTargetSystemLockPoint& LockPoint = LockPoints[LockPointIndex];
+				const USceneComponent* Component = UTargetSystemSubsystem::FindLockPointComponent(Actor, LockPoint);
+				const FVector Location = UTargetSystemSubsystem::GetLockPointLocation(Actor, Component, LockPoint);
+				Candidates.Add({ Actor, LockPointIndex, Location, static_cast<float>(FVector::Dist(OwnerLocation, Location)) });
+			}
 		}
+
+		// Off screen lock points are filtered out before sorting. Range is already checked per actor above.
+		TargetSystem::FQueryKernelContext Context = TargetSystem::MakeQueryKernelContext(OwnerActor, OwnerPlayerController, 0.0f);
+		Context.MaxDistanceSquared = TNumericLimits<float>::Max();
+		TargetSystem::DispatchFilterCandidates(false, Context, Candidates, [this](const FLockPointCandidate& Candidate, const ETargetSystemRejectReason RejectReason, const float Score)
+		{
+			RecordCandidate(Candidate.Actor, RejectReason, Candidate.Distance);
+		});
 	}
 
-	// From the hit actors, check distance and return the nearest
-	if (ActorsHit.Num() == 0)
+	TargetSystem::FScopedQueryTimer ScoreTimer(LastQueryStats.ScoreTime, bIsRecordingQuery);
+
+	Candidates.Sort([](const FLockPointCandidate& A, const FLockPointCandidate& B)
 	{
-		return nullptr;
-	}
+		return A.Distance < B.Distance;
+	});
 
-	float ClosestDistance = ClosestTargetDistance;
-	AActor* Target = nullptr;
-	for (AActor* Actor : ActorsHit)
+	// The first lock point we can line trace to is the nearest one
+	const TArray<AActor*> ActorsToIgnore;
+	for (const FLockPointCandidate& Candidate : Candidates)
 	{
-		const float Distance = GetDistanceFromCharacter(Actor);
-		if (Distance < ClosestDistance)
+		if (!HasLineOfSightToCandidate(Candidate.Actor, Candidate.Location, ActorsToIgnore))
+		{
+			RecordCandidate(Candidate.Actor, ETargetSystemRejectReason::Occluded, Candidate.Distance);
+		}
+		else
 		{
-			ClosestDistance = Distance;
-			Target = Actor;
+			RecordCandidate(Candidate.Actor, ETargetSystemRejectReason::None, Candidate.Distance);
+			OutLockPointIndex = Candidate.LockPointIndex;
+			return Candidate.Actor;
 		}
 	}
 
-	return Target;
+	return nullptr;
 }
 
-
 bool UTargetSystemComponent::LineTraceForActor(const AActor* OtherActor, const TArray<AActor*>& ActorsToIgnore) const
 {
-	FHitResult HitResult;
-	const bool bHit = LineTrace(HitResult, OtherActor, ActorsToIgnore);
-	if (bHit)
+	if (!IsValid(OtherActor))
 	{
-		const AActor* HitActor = HitResult.GetActor();
-		if (HitActor == OtherActor)
-		{
-			return true;
-		}
+		return false;
 	}
 
-	return false;
+	return LineTraceForActor(OtherActor, OtherActor->GetActorLocation(), ActorsToIgnore);
 }
 
-bool UTargetSystemComponent::LineTrace(FHitResult& OutHitResult, const AActor* OtherActor, const TArray<AActor*>& ActorsToIgnore) const
+bool UTargetSystemComponent::LineTraceForActor(const AActor* OtherActor, const FVector& TargetLocation, const TArray<AActor*>& ActorsToIgnore) const
 {
 	if (!IsValid(OwnerActor))
 	{
-		UE_LOG(LogTargetSystem, Warning, TEXT("UTargetSystemComponent::LineTrace - Called with invalid OwnerActor: %s"), *GetNameSafe(OwnerActor))
+		UE_LOG(LogTargetSystem, Warning, TEXT("UTargetSystemComponent::LineTraceForActor - Called with invalid OwnerActor: %s"), *GetNameSafe(OwnerActor))
 		return false;
 	}
 	
 	if (!IsValid(OtherActor))
 	{
-		UE_LOG(LogTargetSystem, Warning, TEXT("UTargetSystemComponent::LineTrace - Called with invalid OtherActor: %s"), *GetNameSafe(OtherActor))
+		UE_LOG(LogTargetSystem, Warning, TEXT("UTargetSystemComponent::LineTraceForActor - Called with invalid OtherActor: %s"), *GetNameSafe(OtherActor))
 		return false;
 	}
-	
-	TArray<AActor*> IgnoredActors;
-	IgnoredActors.Reserve(ActorsToIgnore.Num() + 1);
-	IgnoredActors.Add(OwnerActor);
-	IgnoredActors.Append(ActorsToIgnore);
-	
+
+	return TraceVisibilitySamples(OtherActor, TargetLocation, MakeLineTraceParams(ActorsToIgnore), false);
+}
+
+FCollisionQueryParams UTargetSystemComponent::MakeLineTraceParams(const TArray<AActor*>& ActorsToIgnore) const
+{
 	FCollisionQueryParams Params = FCollisionQueryParams(FName("LineTraceSingle"));
-	Params.AddIgnoredActors(IgnoredActors);
-	
-	if (const UWorld* World = GetWorld(); IsValid(World))
+	Params.AddIgnoredActor(OwnerActor);
+	Params.AddIgnoredActors(ActorsToIgnore);
+	return Params;
+}
+
+bool UTargetSystemComponent::TraceVisibilitySamples(const AActor* OtherActor, const FVector& TargetLocation, const FCollisionQueryParams& Params, const bool bNoHitIsVisible) const
+{
+	const UWorld* World = GetWorld();
+	if (!IsValid(World) || !IsValid(OwnerActor) || !IsValid(OtherActor))
 	{
-		return World->LineTraceSingleByChannel(
-			OutHitResult,
-			OwnerActor->GetActorLocation(),
-			OtherActor->GetActorLocation(),
-			TargetableCollisionChannel,
-			Params
-		);
+		UE_LOG(LogTargetSystem, Warning, TEXT("UTargetSystemComponent::TraceVisibilitySamples - Called with invalid World, OwnerActor or OtherActor: %s"), *GetNameSafe(OtherActor))
+		return false;
 	}
 
-	UE_LOG(LogTargetSystem, Warning, TEXT("UTargetSystemComponent::LineTrace - Called with invalid World: %s"), *GetNameSafe(GetWorld()))
-	return false;
+	FTargetSystemVisibilityCacheKey CacheKey;
+	CacheKey.Actor = OtherActor;
+	CacheKey.TargetLocation = TargetLocation;
+	CacheKey.bNoHitIsVisible = bNoHitIsVisible;
+	for (const auto IgnoredActorId : Params.GetIgnoredActors())
+	{
+		CacheKey.IgnoredActorsHash = HashCombineFast(CacheKey.IgnoredActorsHash, GetTypeHash(IgnoredActorId));
+	}
+
+	if (VisibilityCacheFrame != GFrameCounter)
+	{
+		VisibilityCache.Reset();
+		VisibilityCacheFrame = GFrameCounter;
+	}
+	else if (const bool* bCachedIsVisible = VisibilityCache.Find(CacheKey))
+	{
+		if (bIsRecordingQuery)
+		{
+			LastQueryStats.NumVisibilityCacheHits++;
+		}
+
+		return *bCachedIsVisible;
+	}
+
+	const FVector Start = OwnerActor->GetActorLocation();
+	TargetSystem::FVisibilitySampler Sampler(OtherActor, TargetLocation);
+	TArray<FVector, TInlineAllocator<4>> TracedLocations;
+
+	bool bIsVisible = false;
+	const int32 NumSamples = FMath::Max(VisibilitySamples.Num(), 1);
+	for (int32 SampleIndex = 0; SampleIndex < NumSamples && !bIsVisible; SampleIndex++)
+	{
+		FVector SampleLocation;
+		if (!Sampler.GetLocation(GetVisibilitySample(SampleIndex), SampleLocation))
+		{
+			continue;
+		}
+
+		const bool bIsAlreadyTraced = TracedLocations.ContainsByPredicate([&SampleLocation](const FVector& Location)
+		{
+			return Location.Equals(SampleLocation, 1.0f);
+		});
+
+		if (bIsAlreadyTraced)
+		{
+			continue;
+		}
+
+		TracedLocations.Add(SampleLocation);
+
+		if (bIsRecordingQuery)
+		{
+			LastQueryStats.NumTraces++;
+		}
+
+		FHitResult HitResult;
+		const bool bHit = World->LineTraceSingleByChannel(HitResult, Start, SampleLocation, TargetableCollisionChannel, Params);
+		bIsVisible = bHit ? HitResult.GetActor() == OtherActor : bNoHitIsVisible;
+	}
+
+	VisibilityCache.Add(CacheKey, bIsVisible);
+	return bIsVisible;
+}
+
+FTargetSystemVisibilitySample UTargetSystemComponent::GetVisibilitySample(const int32 Index) const
+{
+	return VisibilitySamples.IsValidIndex(Index) ? VisibilitySamples[Index] : FTargetSystemVisibilitySample();
 }
 
 FRotator UTargetSystemComponent::GetControlRotationOnTarget(const AActor* OtherActor) const
@@ -546,7 +2340,7 @@ FRotator UTargetSystemComponent::GetControlRotationOnTarget(const AActor* OtherA
 	const FRotator ControlRotation = OwnerPlayerController->GetControlRotation();
 
 	const FVector CharacterLocation = OwnerActor->GetActorLocation();
-	const FVector OtherActorLocation = OtherActor->GetActorLocation();
+	const FVector OtherActorLocation = OtherActor == LockedOnTargetActor ? GetLockedOnLocation() : OtherActor->GetActorLocation();
 
 	// Find look at rotation
 	const FRotator LookRotation = FRotationMatrix::MakeFromX(OtherActorLocation - CharacterLocation).Rotator();
@@ -599,6 +2393,144 @@ float UTargetSystemComponent::GetDistanceFromCharacter(const AActor* OtherActor)
 	return OwnerActor->GetDistanceTo(OtherActor);
 }
 
+bool UTargetSystemComponent::ShouldRecordQueryStats() const
+{
+#if UE_BUILD_SHIPPING
+	return false;
+#else
+	return TargetSystem::bRecordQueryStats || FPlatformTime::Seconds() - LastQueryStatsReadTime < TargetSystem::QueryStatsReadTimeout;
+#endif
+}
+
+void UTargetSystemComponent::BeginQueryStats(const FName QueryName)
+{
+	bIsRecordingQuery = ShouldRecordQueryStats();
+	if (bIsRecordingQuery)
+	{
+		const UWorld* World = GetWorld();
+		LastQueryStats.Reset(QueryName, World ? World->GetTimeSeconds() : 0.0);
+	}
+}
+
+void UTargetSystemComponent::EndQueryStats(const AActor* SelectedActor)
+{
+	if (bIsRecordingQuery)
+	{
+		LastQueryStats.SelectedActor = SelectedActor;
+	}
+
+	bIsRecordingQuery = false;
+}
+
+void UTargetSystemComponent::RecordCandidate(const AActor* Actor, const ETargetSystemRejectReason RejectReason, const float Score) const
+{
+	if (!bIsRecordingQuery || !Actor)
+	{
+		return;
+	}
+
+	FTargetSystemQueryCandidate& Candidate = LastQueryStats.FindOrAddCandidate(Actor);
+	Candidate.Location = Actor->GetActorLocation();
+	Candidate.RejectReason = RejectReason;
+	Candidate.Score = Score;
+}
+
+void UTargetSystemComponent::BindToLockedOnTarget(AActor* TargetActor)
+{
+	TargetActor->OnDestroyed.AddUniqueDynamic(this, &UTargetSystemComponent::OnLockedOnTargetDestroyed);
+	TargetActor->OnEndPlay.AddUniqueDynamic(this, &UTargetSystemComponent::OnLockedOnTargetEndPlay);
+
+	if (UTargetSystemSubsystem* Subsystem = GetWorld()->GetSubsystem<UTargetSystemSubsystem>(); Subsystem && !OnTargetableChangedHandle.IsValid())
+	{
+		OnTargetableChangedHandle = Subsystem->OnTargetableChanged.AddUObject(this, &UTargetSystemComponent::OnTargetableChanged);
+	}
+
+	// Check distance and line of sight on next tick, which then schedules the following checks
+	NextDistanceCheckTime = 0.0;
+	NextLineOfSightCheckTime = 0.0;
+
+	UpdateTickEnabled();
+}
+
+void UTargetSystemComponent::UnbindFromLockedOnTarget()
+{
+	if (LockedOnTargetActor)
+	{
+		LockedOnTargetActor->OnDestroyed.RemoveDynamic(this, &UTargetSystemComponent::OnLockedOnTargetDestroyed);
+		LockedOnTargetActor->OnEndPlay.RemoveDynamic(this, &UTargetSystemComponent::OnLockedOnTargetEndPlay);
+	}
+
+	if (OnTargetableChangedHandle.IsValid())
+	{
+		if (const UWorld* World = GetWorld())
+		{
+			if (UTargetSystemSubsystem* Subsystem = World->GetSubsystem<UTargetSystemSubsystem>())
+			{
+				Subsystem->OnTargetableChanged.Remove(OnTargetableChangedHandle);
+			}
+		}
+
+		OnTargetableChangedHandle.Reset();
+	}
+
+	UpdateTickEnabled();
+}
+
+void UTargetSystemComponent::UpdateDistanceCheck(const double WorldTime)
+{
+	const float Distance = GetDistanceFromCharacter(LockedOnTargetActor);
+	if (Distance > MinimumDistanceToEnable)
+	{
+		TargetLockOff();
+		return;
+	}
+
+	// Earliest time the target could get out of range, if owner and target were moving away from each other at full speed
+	const float MaxRelativeSpeed = GetMaxSpeed(OwnerActor) + GetMaxSpeed(LockedOnTargetActor);
+	const float TimeToExit = MaxRelativeSpeed > UE_KINDA_SMALL_NUMBER ? (MinimumDistanceToEnable - Distance) / MaxRelativeSpeed : MaxDistanceCheckInterval;
+
+	NextDistanceCheckTime = WorldTime + FMath::Min(TimeToExit, MaxDistanceCheckInterval);
+}
+
+float UTargetSystemComponent::GetMaxSpeed(const AActor* Actor)
+{
+	float MaxSpeed = Actor->GetVelocity().Size();
+
+	if (const APawn* Pawn = Cast<APawn>(Actor))
+	{
+		if (const UMovementComponent* MovementComponent = Pawn->GetMovementComponent())
+		{
+			MaxSpeed = FMath::Max(MaxSpeed, MovementComponent->GetMaxSpeed());
+		}
+	}
+
+	return MaxSpeed;
+}
+
+void UTargetSystemComponent::OnLockedOnTargetDestroyed(AActor* DestroyedActor)
+{
+	if (DestroyedActor == LockedOnTargetActor)
+	{
+		TargetLockOff();
+	}
+}
+
+void UTargetSystemComponent::OnLockedOnTargetEndPlay(AActor* Actor, EEndPlayReason::Type EndPlayReason)
+{
+	if (Actor == LockedOnTargetActor)
+	{
+		TargetLockOff();
+	}
+}
+
+void UTargetSystemComponent::OnTargetableChanged(AActor* TargetActor)
+{
+	if (TargetActor == LockedOnTargetActor && !TargetIsTargetable(TargetActor))
+	{
+		TargetLockOff();
+	}
+}
+
 bool UTargetSystemComponent::ShouldBreakLineOfSight() const
 {
 	if (!LockedOnTargetActor)
@@ -606,17 +2538,17 @@ bool UTargetSystemComponent::ShouldBreakLineOfSight() const
 		return true;
 	}
 
-	TArray<AActor*> ActorsToIgnore = GetAllActorsOfClass(TargetableActors);
-	ActorsToIgnore.Remove(LockedOnTargetActor);
-
-	FHitResult HitResult;
-	const bool bHit = LineTrace(HitResult, LockedOnTargetActor, ActorsToIgnore);
-	if (bHit && HitResult.GetActor() != LockedOnTargetActor)
+	// Rendered on screen in the last frame or so, no need to trace
+	if (ShouldUseRenderVisibility() && TargetSystem::GetRenderVisibility(GetWorld(), LockedOnTargetActor, 0.0f) == TargetSystem::ERenderVisibility::Rendered)
 	{
-		return true;
+		NumLineOfSightTracesAvoided++;
+		return false;
 	}
 
-	return false;
+	// Traced to the locked on point, only breaking when every sample hits something other than the target. Other
+	// targetables in the way count as occluders, BreakLineOfSightDelay covering the ones only passing by.
+	const TArray<AActor*> ActorsToIgnore;
+	return !TraceVisibilitySamples(LockedOnTargetActor, GetLockedOnLocation(), MakeLineTraceParams(ActorsToIgnore), true);
 }
 
 void UTargetSystemComponent::BreakLineOfSight()
@@ -624,7 +2556,108 @@ void UTargetSystemComponent::BreakLineOfSight()
 	bIsBreakingLineOfSight = false;
 	if (ShouldBreakLineOfSight())
 	{
-		TargetLockOff();
+		LockOffFromLineOfSight();
+	}
+}
+
+void UTargetSystemComponent::LockOffFromLineOfSight()
+{
+	AActor* LostTarget = LockedOnTargetActor;
+	TargetLockOff();
+
+	FTargetSystemRecentTarget* RecentTarget = RecentTargets.Find(LostTarget);
+	if (!RecentTarget)
+	{
+		return;
+	}
+
+	RecentTarget->bLostSight = true;
+
+	if (bRelockOnRegainSight && IsOwnerLocallyControlled())
+	{
+		GetWorld()->GetTimerManager().SetTimer(
+			RegainSightTimerHandle,
+			this,
+			&UTargetSystemComponent::CheckRegainSight,
+			FMath::Max(RegainSightCheckInterval, 0.01f),
+			true
+		);
+	}
+}
+
+AActor* UTargetSystemComponent::FindRecentTarget(const bool bLostSightOnly, int32& OutLockPointIndex)
+{
+	OutLockPointIndex = 0;
+
+	if (!IsValid(OwnerActor))
+	{
+		return nullptr;
+	}
+
+	// Recast PlayerController in case it wasn't already setup on Begin Play (local split screen)
+	SetupLocalPlayerController();
+
+	const double MinTimestamp = GetWorld()->GetTimeSeconds() - RecentTargetMemoryDuration;
+	const FTargetSystemRecentTarget* RecentTarget = RecentTargets.FindMostRecent(MinTimestamp, [this, bLostSightOnly](const FTargetSystemRecentTarget& Entry)
+	{
+		const AActor* Actor = Entry.Actor.Get();
+		return (Entry.bLostSight || !bLostSightOnly)
+			&& IsValid(Actor)
+			&& GetDistanceFromCharacter(Actor) < MinimumDistanceToEnable
+			&& TargetIsTargetable(Actor);
+	});
+
+	if (!RecentTarget)
+	{
+		return nullptr;
+	}
+
+	AActor* Actor = RecentTarget->Actor.Get();
+	const float Distance = GetDistanceFromCharacter(Actor);
+
+	const TConstArrayView<FTargetSystemLockPoint> LockPoints = GetLockPoints(Actor);
+	const int32 LockPointIndex = LockPoints.IsValidIndex(RecentTarget->LockPointIndex) ? RecentTarget->LockPointIndex : 0;
+	const FTargetSystemLockPoint& LockPoint = LockPoints[LockPointIndex];
+	const FVector Location = UTargetSystemSubsystem::GetLockPointLocation(Actor, UTargetSystemSubsystem::FindLockPointComponent(Actor, LockPoint), LockPoint);
+
+	if (!IsInViewport(Location))
+	{
+		RecordCandidate(Actor, ETargetSystemRejectReason::OffScreen, Distance);
+		return nullptr;
+	}
+
+	const TArray<AActor*> ActorsToIgnore;
+	if (!HasLineOfSightToCandidate(Actor, Location, ActorsToIgnore))
+	{
+		RecordCandidate(Actor, ETargetSystemRejectReason::Occluded, Distance);
+		return nullptr;
+	}
+
+	RecordCandidate(Actor, ETargetSystemRejectReason::None, Distance);
+	OutLockPointIndex = LockPointIndex;
+	return Actor;
+}
+
+void UTargetSystemComponent::CheckRegainSight()
+{
+	const double MinTimestamp = GetWorld()->GetTimeSeconds() - RecentTargetMemoryDuration;
+	const bool bHasLostTarget = RecentTargets.FindMostRecent(MinTimestamp, [](const FTargetSystemRecentTarget& Entry)
+	{
+		return Entry.bLostSight;
+	}) != nullptr;
+
+	// Stop polling once locked on again, or once every lost target has been forgotten. Only the owning client relocks,
+	// through the predicted ServerRequestLockOn() path, so that the server never relocks a remote pawn on its own.
+	if (bTargetLocked || !bRelockOnRegainSight || !bHasLostTarget || !IsOwnerLocallyControlled())
+	{
+		GetWorld()->GetTimerManager().ClearTimer(RegainSightTimerHandle);
+		return;
+	}
+
+	int32 LockPointIndex = 0;
+	if (AActor* Target = FindRecentTarget(true, LockPointIndex))
+	{
+		TargetLockOn(Target, LockPointIndex);
 	}
 }
 
@@ -645,6 +2678,11 @@ void UTargetSystemComponent::ControlRotation(const bool ShouldControlRotation) c
 }
 
 bool UTargetSystemComponent::IsInViewport(const AActor* TargetActor) const
+{
+	return IsInViewport(TargetActor->GetActorLocation());
+}
+
+bool UTargetSystemComponent::IsInViewport(const FVector& Location) const
 {
 	if (!IsValid(OwnerPlayerController))
 	{
@@ -652,7 +2690,7 @@ bool UTargetSystemComponent::IsInViewport(const AActor* TargetActor) const
 	}
 
 	FVector2D ScreenLocation;
-	OwnerPlayerController->ProjectWorldLocationToScreen(TargetActor->GetActorLocation(), ScreenLocation);
+	OwnerPlayerController->ProjectWorldLocationToScreen(Location, ScreenLocation);
 
 	FVector2D ViewportSize;
 	GetWorld()->GetGameViewport()->GetViewportSize(ViewportSize);
@@ -0,0 +1,143 @@
+// Copyright 2018-2021 Mickael Daniel. All Rights Reserved.
+
+#include "CoreMinimal.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "TargetSystemComponent.h"
+#include "AIController.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "GameFramework/DefaultPawn.h"
+#include "GameFramework/WorldSettings.h"
+
+/**
+ * Tests of a single Target System Component in a standalone game world, with pawns possessed by AI Controllers so that
+ * they are locally controlled.
+ *
+ * Friend of UTargetSystemComponent, to drive its private steps directly and read the query stats they record.
+ */
+class FTargetSystemComponentTests
+{
+public:
+	static UWorld* CreateWorld();
+	static void DestroyWorld(UWorld* World);
+
+	static APawn* SpawnPawn(UWorld* World, const FVector& Location);
+	static UTargetSystemComponent* AddComponent(APawn* Pawn);
+
+	static void LockOn(UTargetSystemComponent* Component, AActor* Target)
+	{
+		Component->LockedOnTargetActor = Target;
+		Component->TargetLockOn(Target);
+	}
+
+	// Runs a single regain sight check, recording its query stats
+	static const FTargetSystemQueryStats& CheckRegainSight(UTargetSystemComponent* Component)
+	{
+		// Reading the stats keeps them recorded for a while
+		Component->GetLastQueryStats();
+
+		Component->BeginQueryStats(FName("CheckRegainSight"));
+		Component->CheckRegainSight();
+		Component->EndQueryStats(Component->GetLockedOnTargetActor());
+
+		return Component->LastQueryStats;
+	}
+
+	static void LockOffFromLineOfSight(UTargetSystemComponent* Component)
+	{
+		Component->LockOffFromLineOfSight();
+	}
+};
+
+UWorld* FTargetSystemComponentTests::CreateWorld()
+{
+	UWorld* World = UWorld::CreateWorld(EWorldType::Game, false);
+	FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	WorldContext.SetCurrentWorld(World);
+
+	World->InitializeActorsForPlay(FURL());
+	World->BeginPlay();
+
+	// Without a Game Mode, actors are not told to begin play
+	if (!World->HasBegunPlay())
+	{
+		World->GetWorldSettings()->NotifyBeginPlay();
+	}
+
+	return World;
+}
+
+void FTargetSystemComponentTests::DestroyWorld(UWorld* World)
+{
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(false);
+}
+
+APawn* FTargetSystemComponentTests::SpawnPawn(UWorld* World, const FVector& Location)
+{
+	FActorSpawnParameters SpawnParameters;
+	SpawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+	APawn* Pawn = World->SpawnActor<ADefaultPawn>(ADefaultPawn::StaticClass(), Location, FRotator::ZeroRotator, SpawnParameters);
+	if (Pawn)
+	{
+		Pawn->AIControllerClass = AAIController::StaticClass();
+		Pawn->SpawnDefaultController();
+	}
+
+	return Pawn;
+}
+
+UTargetSystemComponent* FTargetSystemComponentTests::AddComponent(APawn* Pawn)
+{
+	UTargetSystemComponent* Component = NewObject<UTargetSystemComponent>(Pawn, TEXT("TargetSystem"));
+	Component->bShouldDrawLockedOnWidget = false;
+	Component->RegisterComponent();
+	return Component;
+}
+
+/**
+ * Relocking on a target whose sight was lost and regained costs a single line trace, and never gathers candidates
+ * (which iterates the actors of the world with the ActorIterator candidate source).
+ */
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTargetSystemRegainSightRelockTest, "TargetSystem.RecentTargets.RegainSightRelockCost", EAutomationTestFlags::EditorContext | EAutomationTestFlags::ClientContext | EAutomationTestFlags::ProductFilter)
+
+bool FTargetSystemRegainSightRelockTest::RunTest(const FString& Parameters)
+{
+	UWorld* World = FTargetSystemComponentTests::CreateWorld();
+
+	APawn* Owner = FTargetSystemComponentTests::SpawnPawn(World, FVector(0.0f, 0.0f, 100.0f));
+	APawn* Target = FTargetSystemComponentTests::SpawnPawn(World, FVector(600.0f, 0.0f, 100.0f));
+
+	// Other targetables in range, which a world scan or a full query would go through
+	for (int32 Index = 0; Index < 8; Index++)
+	{
+		FTargetSystemComponentTests::SpawnPawn(World, FVector(-600.0f, (Index - 4) * 200.0f, 100.0f));
+	}
+
+	if (TestNotNull(TEXT("Owner"), Owner) && TestNotNull(TEXT("Target"), Target))
+	{
+		UTargetSystemComponent* Component = FTargetSystemComponentTests::AddComponent(Owner);
+		Component->bRelockOnRegainSight = true;
+
+		// Lets physics pick up the spawned pawns before tracing to them
+		World->Tick(LEVELTICK_All, 1.0f / 60.0f);
+
+		FTargetSystemComponentTests::LockOn(Component, Target);
+		FTargetSystemComponentTests::LockOffFromLineOfSight(Component);
+		TestFalse(TEXT("Locked off after losing sight"), Component->IsLocked());
+
+		const FTargetSystemQueryStats& Stats = FTargetSystemComponentTests::CheckRegainSight(Component);
+		TestTrue(TEXT("Locked back on the target"), Component->IsLocked() && Component->GetLockedOnTargetActor() == Target);
+		TestEqual(TEXT("Line traces per relock"), Stats.NumTraces, 1);
+		TestEqual(TEXT("Candidate gathers per relock"), Stats.NumGathers, 0);
+	}
+
+	FTargetSystemComponentTests::DestroyWorld(World);
+	return true;
+}
+
+#endif
@@ -0,0 +1,372 @@
+// Copyright 2018-2021 Mickael Daniel. All Rights Reserved.
+
+#include "CoreMinimal.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS && WITH_EDITOR
+
+#include "Editor.h"
+#include "EngineUtils.h"
+#include "TargetSystemComponent.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "GameFramework/DefaultPawn.h"
+#include "GameFramework/GameModeBase.h"
+#include "GameFramework/PlayerController.h"
+#include "Settings/LevelEditorPlaySettings.h"
+#include "Tests/AutomationCommon.h"
+#include "Tests/AutomationEditorCommon.h"
+
+/**
+ * Listen server PIE test of the lock replication: a lock on predicted by the owning client and accepted by the server,
+ * one rejected by the server (answered with ClientLockOff()), and a lock mirrored on a simulated proxy through
+ * OnRep_ReplicatedLock().
+ *
+ * Friend of UTargetSystemComponent, to lock on a given target without going through a query.
+ */
+class FTargetSystemNetworkTests
+{
+public:
+	struct FState
+	{
+		TWeakObjectPtr<UWorld> ServerWorld;
+		TWeakObjectPtr<UWorld> ClientWorld;
+
+		// Pawns of the listen server host and of the remote client, in both worlds
+		TWeakObjectPtr<APawn> ServerHostPawn;
+		TWeakObjectPtr<APawn> ServerClientPawn;
+		TWeakObjectPtr<APawn> ClientHostPawn;
+		TWeakObjectPtr<APawn> ClientPawn;
+
+		// A target in range of both pawns, and one out of range, in both worlds
+		TWeakObjectPtr<AActor> ServerNearTarget;
+		TWeakObjectPtr<AActor> ServerFarTarget;
+		TWeakObjectPtr<AActor> ClientNearTarget;
+		TWeakObjectPtr<AActor> ClientFarTarget;
+	};
+
+	// Steps failing the test when their condition isn't met within this time (in seconds)
+	static constexpr double StepTimeout = 10.0;
+
+	static const FVector HostLocation;
+	static const FVector ClientLocation;
+	static const FVector NearTargetLocation;
+	static const FVector FarTargetLocation;
+
+	// Finds both play worlds, once the client has joined and both players have a pawn
+	static bool FindPlayWorlds(FState& State);
+
+	// Adds a Target System Component to both player pawns, and spawns the targets (server only, replicated to the client)
+	static void SetupServer(FState& State);
+
+	// Finds the replicated components and targets on the client
+	static bool FindClientActors(FState& State);
+
+	static UTargetSystemComponent* GetComponent(const TWeakObjectPtr<APawn>& Pawn);
+
+	static void LockOn(UTargetSystemComponent* Component, AActor* Target)
+	{
+		Component->LockedOnTargetActor = Target;
+		Component->TargetLockOn(Target);
+	}
+};
+
+const FVector FTargetSystemNetworkTests::HostLocation(0.0f, -300.0f, 100.0f);
+const FVector FTargetSystemNetworkTests::ClientLocation(0.0f, 300.0f, 100.0f);
+const FVector FTargetSystemNetworkTests::NearTargetLocation(600.0f, 0.0f, 100.0f);
+const FVector FTargetSystemNetworkTests::FarTargetLocation(6000.0f, 0.0f, 100.0f);
+
+namespace TargetSystem
+{
+	// Runs Step every frame until it returns true, failing the test if it doesn't within FTargetSystemNetworkTests::StepTimeout
+	class FWaitForNetworkStep : public IAutomationLatentCommand
+	{
+	public:
+		FWaitForNetworkStep(FAutomationTestBase* InTest, const TCHAR* InDescription, TFunction<bool()>&& InStep)
+			: Test(InTest)
+			, Description(InDescription)
+			, Step(MoveTemp(InStep))
+		{
+		}
+
+		virtual bool Update() override
+		{
+			if (Step())
+			{
+				return true;
+			}
+
+			if (GetCurrentRunTime() > FTargetSystemNetworkTests::StepTimeout)
+			{
+				Test->AddError(FString::Printf(TEXT("Timed out waiting for %s"), *Description));
+				return true;
+			}
+
+			return false;
+		}
+
+	private:
+		FAutomationTestBase* Test;
+		FString Description;
+		TFunction<bool()> Step;
+	};
+
+	static void AddNetworkStep(FAutomationTestBase* Test, const TCHAR* Description, TFunction<bool()>&& Step)
+	{
+		FAutomationTestFramework::Get().EnqueueLatentCommand(MakeShared<FWaitForNetworkStep>(Test, Description, MoveTemp(Step)));
+	}
+
+	static AActor* FindActorAt(UWorld* World, const FVector& Location)
+	{
+		for (TActorIterator<ADefaultPawn> It(World); It; ++It)
+		{
+			if (!It->GetController() && It->GetActorLocation().Equals(Location, 10.0f))
+			{
+				return *It;
+			}
+		}
+
+		return nullptr;
+	}
+}
+
+bool FTargetSystemNetworkTests::FindPlayWorlds(FState& State)
+{
+	for (const FWorldContext& Context : GEngine->GetWorldContexts())
+	{
+		UWorld* World = Context.World();
+		if (Context.WorldType != EWorldType::PIE || !World || !World->HasBegunPlay())
+		{
+			continue;
+		}
+
+		if (World->GetNetMode() == NM_ListenServer)
+		{
+			State.ServerWorld = World;
+		}
+		else if (World->GetNetMode() == NM_Client)
+		{
+			State.ClientWorld = World;
+		}
+	}
+
+	UWorld* ServerWorld = State.ServerWorld.Get();
+	UWorld* ClientWorld = State.ClientWorld.Get();
+	if (!ServerWorld || !ClientWorld)
+	{
+		return false;
+	}
+
+	for (FConstPlayerControllerIterator It = ServerWorld->GetPlayerControllerIterator(); It; ++It)
+	{
+		const APlayerController* PlayerController = It->Get();
+		if (!PlayerController || !PlayerController->GetPawn())
+		{
+			continue;
+		}
+
+		if (PlayerController->IsLocalController())
+		{
+			State.ServerHostPawn = PlayerController->GetPawn();
+		}
+		else
+		{
+			State.ServerClientPawn = PlayerController->GetPawn();
+		}
+	}
+
+	const APlayerController* ClientController = GEngine->GetFirstLocalPlayerController(ClientWorld);
+	State.ClientPawn = ClientController ? ClientController->GetPawn() : nullptr;
+
+	return State.ServerHostPawn.IsValid() && State.ServerClientPawn.IsValid() && State.ClientPawn.IsValid();
+}
+
+void FTargetSystemNetworkTests::SetupServer(FState& State)
+{
+	UWorld* ServerWorld = State.ServerWorld.Get();
+	if (!ServerWorld || !State.ServerHostPawn.IsValid() || !State.ServerClientPawn.IsValid())
+	{
+		return;
+	}
+
+	// Server side locations are the ones lock ons are validated against
+	State.ServerHostPawn->SetActorLocation(HostLocation);
+	State.ServerClientPawn->SetActorLocation(ClientLocation);
+
+	for (APawn* Pawn : { State.ServerHostPawn.Get(), State.ServerClientPawn.Get() })
+	{
+		UTargetSystemComponent* Component = NewObject<UTargetSystemComponent>(Pawn, FName("TargetSystem"));
+		Component->bShouldDrawLockedOnWidget = false;
+		Component->RegisterComponent();
+	}
+
+	FActorSpawnParameters SpawnParameters;
+	SpawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	State.ServerNearTarget = ServerWorld->SpawnActor<ADefaultPawn>(ADefaultPawn::StaticClass(), NearTargetLocation, FRotator::ZeroRotator, SpawnParameters);
+	State.ServerFarTarget = ServerWorld->SpawnActor<ADefaultPawn>(ADefaultPawn::StaticClass(), FarTargetLocation, FRotator::ZeroRotator, SpawnParameters);
+}
+
+bool FTargetSystemNetworkTests::FindClientActors(FState& State)
+{
+	UWorld* ClientWorld = State.ClientWorld.Get();
+	if (!ClientWorld)
+	{
+		return false;
+	}
+
+	for (TActorIterator<APawn> It(ClientWorld); It; ++It)
+	{
+		if (It->GetLocalRole() == ROLE_SimulatedProxy && It->FindComponentByClass<UTargetSystemComponent>())
+		{
+			State.ClientHostPawn = *It;
+		}
+	}
+
+	State.ClientNearTarget = TargetSystem::FindActorAt(ClientWorld, NearTargetLocation);
+	State.ClientFarTarget = TargetSystem::FindActorAt(ClientWorld, FarTargetLocation);
+
+	const UTargetSystemComponent* ClientComponent = GetComponent(State.ClientPawn);
+	const UTargetSystemComponent* ClientHostComponent = GetComponent(State.ClientHostPawn);
+	return ClientComponent && ClientComponent->HasBegunPlay()
+		&& ClientHostComponent && ClientHostComponent->HasBegunPlay()
+		&& State.ClientNearTarget.IsValid() && State.ClientFarTarget.IsValid();
+}
+
+UTargetSystemComponent* FTargetSystemNetworkTests::GetComponent(const TWeakObjectPtr<APawn>& Pawn)
+{
+	return Pawn.IsValid() ? Pawn->FindComponentByClass<UTargetSystemComponent>() : nullptr;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTargetSystemListenServerLockTest, "TargetSystem.Network.ListenServerLock", EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+bool FTargetSystemListenServerLockTest::RunTest(const FString& Parameters)
+{
+	using FTests = FTargetSystemNetworkTests;
+
+	FAutomationEditorCommonUtils::CreateNewMap();
+
+	// Listen server host and one client, in the same process
+	ULevelEditorPlaySettings* PlaySettings = NewObject<ULevelEditorPlaySettings>();
+	PlaySettings->SetPlayNetMode(EPlayNetMode::PIE_ListenServer);
+	PlaySettings->SetPlayNumberOfClients(2);
+	PlaySettings->SetRunUnderOneProcess(true);
+
+	FRequestPlaySessionParams PlaySessionParams;
+	PlaySessionParams.WorldType = EPlaySessionWorldType::PlayInEditor;
+	PlaySessionParams.EditorPlaySettings = PlaySettings;
+	PlaySessionParams.GameModeOverride = AGameModeBase::StaticClass();
+	GEditor->RequestPlaySession(PlaySessionParams);
+
+	const TSharedRef<FTests::FState> State = MakeShared<FTests::FState>();
+
+	TargetSystem::AddNetworkStep(this, TEXT("the client to join the listen server"), [State]()
+	{
+		return FTests::FindPlayWorlds(*State);
+	});
+
+	TargetSystem::AddNetworkStep(this, TEXT("the server setup"), [State]()
+	{
+		FTests::SetupServer(*State);
+		return true;
+	});
+
+	TargetSystem::AddNetworkStep(this, TEXT("components and targets to replicate to the client"), [State]()
+	{
+		return FTests::FindClientActors(*State);
+	});
+
+	// Lock on predicted by the owning client, then accepted by the server
+	TargetSystem::AddNetworkStep(this, TEXT("the predicted lock on"), [this, State]()
+	{
+		UTargetSystemComponent* ClientComponent = FTests::GetComponent(State->ClientPawn);
+		if (ClientComponent)
+		{
+			FTests::LockOn(ClientComponent, State->ClientNearTarget.Get());
+			TestTrue(TEXT("Client predicts its lock on"), ClientComponent->IsLocked());
+		}
+
+		return true;
+	});
+
+	TargetSystem::AddNetworkStep(this, TEXT("the server to accept the predicted lock on"), [State]()
+	{
+		const UTargetSystemComponent* ServerComponent = FTests::GetComponent(State->ServerClientPawn);
+		return ServerComponent && ServerComponent->IsLocked() && ServerComponent->GetLockedOnTargetActor() == State->ServerNearTarget.Get();
+	});
+
+	ADD_LATENT_AUTOMATION_COMMAND(FEngineWaitLatentCommand(0.5f));
+
+	TargetSystem::AddNetworkStep(this, TEXT("the accepted lock on to be kept"), [this, State]()
+	{
+		const UTargetSystemComponent* ClientComponent = FTests::GetComponent(State->ClientPawn);
+		TestTrue(TEXT("Client keeps the lock on accepted by the server"), ClientComponent && ClientComponent->GetLockedOnTargetActor() == State->ClientNearTarget.Get());
+		return true;
+	});
+
+	// Lock on predicted by the owning client, then rejected by the server (out of range) with ClientLockOff()
+	TargetSystem::AddNetworkStep(this, TEXT("the predicted out of range lock on"), [this, State]()
+	{
+		UTargetSystemComponent* ClientComponent = FTests::GetComponent(State->ClientPawn);
+		if (ClientComponent)
+		{
+			// Only the server enforces the range, so that the lock off can only come from its rejection
+			ClientComponent->MinimumDistanceToEnable = FTests::FarTargetLocation.Size() * 2.0f;
+			ClientComponent->TargetLockOff();
+			FTests::LockOn(ClientComponent, State->ClientFarTarget.Get());
+			TestTrue(TEXT("Client predicts its out of range lock on"), ClientComponent->IsLocked());
+		}
+
+		return true;
+	});
+
+	TargetSystem::AddNetworkStep(this, TEXT("the server to reject the out of range lock on"), [State]()
+	{
+		const UTargetSystemComponent* ClientComponent = FTests::GetComponent(State->ClientPawn);
+		return ClientComponent && !ClientComponent->IsLocked();
+	});
+
+	TargetSystem::AddNetworkStep(this, TEXT("the rejected lock on to be released on the server"), [this, State]()
+	{
+		const UTargetSystemComponent* ServerComponent = FTests::GetComponent(State->ServerClientPawn);
+		TestFalse(TEXT("Server didn't lock on the rejected target"), ServerComponent && ServerComponent->IsLocked());
+		return true;
+	});
+
+	// Lock on of the host, mirrored on its simulated proxy through OnRep_ReplicatedLock()
+	TargetSystem::AddNetworkStep(this, TEXT("the host lock on"), [State]()
+	{
+		if (UTargetSystemComponent* HostComponent = FTests::GetComponent(State->ServerHostPawn))
+		{
+			FTests::LockOn(HostComponent, State->ServerNearTarget.Get());
+		}
+
+		return true;
+	});
+
+	TargetSystem::AddNetworkStep(this, TEXT("the simulated proxy to mirror the host lock on"), [State]()
+	{
+		const UTargetSystemComponent* ClientHostComponent = FTests::GetComponent(State->ClientHostPawn);
+		return ClientHostComponent && ClientHostComponent->IsLocked() && ClientHostComponent->GetLockedOnTargetActor() == State->ClientNearTarget.Get();
+	});
+
+	TargetSystem::AddNetworkStep(this, TEXT("the host lock off"), [State]()
+	{
+		if (UTargetSystemComponent* HostComponent = FTests::GetComponent(State->ServerHostPawn))
+		{
+			HostComponent->TargetLockOff();
+		}
+
+		return true;
+	});
+
+	TargetSystem::AddNetworkStep(this, TEXT("the simulated proxy to mirror the host lock off"), [State]()
+	{
+		const UTargetSystemComponent* ClientHostComponent = FTests::GetComponent(State->ClientHostPawn);
+		return ClientHostComponent && !ClientHostComponent->IsLocked();
+	});
+
+	ADD_LATENT_AUTOMATION_COMMAND(FEndPlayMapCommand());
+	return true;
+}
+
+#endif
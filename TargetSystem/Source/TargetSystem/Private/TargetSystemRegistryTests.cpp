@@ -0,0 +1,203 @@
+// Copyright 2018-2021 Mickael Daniel. All Rights Reserved.
+
+#include "CoreMinimal.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "TargetSystemSubsystem.h"
+#include "Algo/AllOf.h"
+#include "Engine/Engine.h"
+#include "Engine/Level.h"
+#include "Engine/LevelStreamingDynamic.h"
+#include "Engine/TargetPoint.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/PackageName.h"
+#include "UObject/Package.h"
+
+namespace TargetSystem
+{
+	// Cells streamed in one after the other, each one streaming out once NumLoadedCells newer ones are in
+	static constexpr int32 NumStreamedCells = 12;
+	static constexpr int32 NumActorsPerCell = 2000;
+	static constexpr int32 NumLoadedCells = 4;
+
+	// Frames between two cells streaming in
+	static constexpr int32 FramesPerCell = 3;
+
+	// Frames given to the last cells to stream in and out, and to be registered
+	static constexpr int32 MaxStreamingFrames = 600;
+
+	static constexpr float StreamingDeltaSeconds = 1.0f / 60.0f;
+
+	// Percentile of the registry time of ticks checked against the time budget, and what is allowed on top of it: the
+	// batch of actors started just before the budget is spent, and timer noise
+	static constexpr float RegistryTickPercentile = 0.95f;
+	static constexpr double RegistryTickTolerance = 0.25 / 1000.0;
+
+	// A world saved nowhere, filled with actors, to be streamed in another world as one of its levels
+	static UWorld* CreateCell(const int32 CellIndex)
+	{
+		const FName PackageName = MakeUniqueObjectName(nullptr, UPackage::StaticClass(), FName(*FString::Printf(TEXT("/Temp/TargetSystemCell_%d"), CellIndex)));
+		UPackage* Package = CreatePackage(*PackageName.ToString());
+		Package->SetFlags(RF_Transient);
+
+		UWorld::InitializationValues InitializationValues;
+		InitializationValues
+			.AllowAudioPlayback(false)
+			.CreatePhysicsScene(false)
+			.CreateNavigation(false)
+			.CreateAISystem(false)
+			.SetTransactional(false);
+
+		const FName WorldName(*FPackageName::GetShortName(Package));
+		UWorld* Cell = UWorld::CreateWorld(EWorldType::Inactive, false, WorldName, Package, false, ERHIFeatureLevel::Num, &InitializationValues);
+
+		FActorSpawnParameters SpawnParameters;
+		SpawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+		const FVector CellOrigin(CellIndex * 10000.0f, 0.0f, 0.0f);
+		for (int32 Index = 0; Index < NumActorsPerCell; Index++)
+		{
+			const FVector Location = CellOrigin + FVector((Index % 50) * 200.0f, (Index / 50) * 200.0f, 0.0f);
+			Cell->SpawnActor<ATargetPoint>(ATargetPoint::StaticClass(), Location, FRotator::ZeroRotator, SpawnParameters);
+		}
+
+		// Left like a level loaded from disk, its components are registered with the world it is streamed in
+		Cell->ClearWorldComponents();
+		Cell->CleanupWorld();
+
+		return Cell;
+	}
+
+	static ULevelStreamingDynamic* StreamInCell(UWorld* World, UWorld* Cell)
+	{
+		// Same as ULevelStreamingDynamic::LoadLevelInstance(), which only loads packages from disk. The package of the cell
+		// is already in memory, and used as is.
+		ULevelStreamingDynamic* StreamingLevel = NewObject<ULevelStreamingDynamic>(World, NAME_None, RF_Transient);
+		StreamingLevel->SetWorldAsset(TSoftObjectPtr<UWorld>(Cell));
+		StreamingLevel->SetShouldBeLoaded(true);
+		StreamingLevel->SetShouldBeVisible(true);
+
+		World->AddStreamingLevel(StreamingLevel);
+		return StreamingLevel;
+	}
+
+	static double GetPercentile(TArray<double> Values, const float Percentile)
+	{
+		if (Values.Num() == 0)
+		{
+			return 0.0;
+		}
+
+		Values.Sort();
+		return Values[FMath::Min(FMath::FloorToInt(Percentile * Values.Num()), Values.Num() - 1)];
+	}
+}
+
+/**
+ * Streams cells in and out of a ticking world registering ATargetPoint actors, and checks the time the subsystem spends
+ * registering them per tick against TargetSystem.RegistryTimeBudgetMs:
+ *
+ * - The last batch of actors of every tick started within the budget (see FTargetSystemRegistryTickStats)
+ * - The RegistryTickPercentile of tick times stays within the budget, give or take RegistryTickTolerance
+ *
+ * Frame times (level streaming included) are only logged, as they mostly measure components registering.
+ */
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTargetSystemRegistryStreamingTest, "TargetSystem.Registry.StreamingFrameTime", EAutomationTestFlags::EditorContext | EAutomationTestFlags::ClientContext | EAutomationTestFlags::ProductFilter)
+
+bool FTargetSystemRegistryStreamingTest::RunTest(const FString& Parameters)
+{
+	using namespace TargetSystem;
+
+	UWorld* World = UWorld::CreateWorld(EWorldType::Game, false);
+	FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	WorldContext.SetCurrentWorld(World);
+
+	World->InitializeActorsForPlay(FURL());
+	World->BeginPlay();
+
+	UTargetSystemSubsystem* Subsystem = World->GetSubsystem<UTargetSystemSubsystem>();
+	if (TestNotNull(TEXT("Target System Subsystem"), Subsystem))
+	{
+		Subsystem->RegisterTargetableClass(ATargetPoint::StaticClass());
+
+		const IConsoleVariable* BudgetVariable = IConsoleManager::Get().FindConsoleVariable(TEXT("TargetSystem.RegistryTimeBudgetMs"));
+		const double TimeBudget = (BudgetVariable ? BudgetVariable->GetFloat() : 0.5f) / 1000.0;
+
+		// Cells are created up front, so that frames only include them streaming in and out
+		TArray<UWorld*> Cells;
+		for (int32 CellIndex = 0; CellIndex < NumStreamedCells; CellIndex++)
+		{
+			Cells.Add(CreateCell(CellIndex));
+		}
+
+		TArray<ULevelStreamingDynamic*> StreamingLevels;
+		TArray<double> FrameTimes;
+		TArray<double> RegistryTickTimes;
+		double WorstBatchStartTime = 0.0;
+		bool bIsStreamingDone = false;
+
+		for (int32 Frame = 0; Frame < MaxStreamingFrames && !bIsStreamingDone; Frame++)
+		{
+			if (Frame % FramesPerCell == 0 && StreamingLevels.Num() < NumStreamedCells)
+			{
+				StreamingLevels.Add(StreamInCell(World, Cells[StreamingLevels.Num()]));
+
+				if (StreamingLevels.Num() > NumLoadedCells)
+				{
+					StreamingLevels[StreamingLevels.Num() - NumLoadedCells - 1]->SetIsRequestingUnloadAndRemoval(true);
+				}
+			}
+
+			const double StartTime = FPlatformTime::Seconds();
+			World->UpdateLevelStreaming();
+			World->Tick(LEVELTICK_All, StreamingDeltaSeconds);
+			FrameTimes.Add(FPlatformTime::Seconds() - StartTime);
+
+			const FTargetSystemRegistryTickStats& Stats = Subsystem->GetLastRegistryTickStats();
+			if (Stats.NumBatches > 0)
+			{
+				RegistryTickTimes.Add(Stats.Time);
+				WorstBatchStartTime = FMath::Max(WorstBatchStartTime, Stats.LastBatchStartTime);
+			}
+
+			// Streamed out cells are removed from the world's streaming levels once unloaded
+			bIsStreamingDone = StreamingLevels.Num() == NumStreamedCells
+				&& Subsystem->GetNumPendingLevels() == 0
+				&& World->GetStreamingLevels().Num() == NumLoadedCells
+				&& Algo::AllOf(World->GetStreamingLevels(), [](const ULevelStreaming* StreamingLevel)
+				{
+					return StreamingLevel && StreamingLevel->IsLevelVisible();
+				});
+		}
+
+		const double RegistryTickTime = GetPercentile(RegistryTickTimes, RegistryTickPercentile);
+		AddInfo(FString::Printf(TEXT("%d cells of %d actors streamed in %d frames - Frame p50: %.3fms, p95: %.3fms - Registry ticks: %d, p50: %.3fms, p95: %.3fms, budget: %.3fms"),
+			NumStreamedCells,
+			NumActorsPerCell,
+			FrameTimes.Num(),
+			GetPercentile(FrameTimes, 0.5f) * 1000.0,
+			GetPercentile(FrameTimes, 0.95f) * 1000.0,
+			RegistryTickTimes.Num(),
+			GetPercentile(RegistryTickTimes, 0.5f) * 1000.0,
+			GetPercentile(RegistryTickTimes, 0.95f) * 1000.0,
+			TimeBudget * 1000.0
+		));
+
+		TestTrue(TEXT("Cells streamed in and out within the frame limit"), bIsStreamingDone);
+		TestEqual(TEXT("Actors of the cells still loaded are registered"), Subsystem->GetNumRegisteredTargets(), NumLoadedCells * NumActorsPerCell);
+		TestTrue(FString::Printf(TEXT("Last batch of every tick (worst: %.3fms) starts within the time budget (%.3fms)"), WorstBatchStartTime * 1000.0, TimeBudget * 1000.0),
+			WorstBatchStartTime < TimeBudget);
+		TestTrue(FString::Printf(TEXT("Registry tick time p%.0f (%.3fms) stays within the time budget (%.3fms)"), RegistryTickPercentile * 100.0f, RegistryTickTime * 1000.0, TimeBudget * 1000.0),
+			RegistryTickTime <= TimeBudget + RegistryTickTolerance);
+	}
+
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(false);
+
+	return true;
+}
+
+#endif
@@ -0,0 +1,198 @@
+// Copyright 2018-2021 Mickael Daniel. All Rights Reserved.
+
+#include "TargetSystemScreenGrid.h"
+
+void FTargetSystemScreenGrid::Build(const FVector2D& InViewportSize, TArray<FEntry>&& InEntries, const float InCellSize, const uint64 InFrameNumber)
+{
+	Entries = MoveTemp(InEntries);
+	ViewportSize = InViewportSize;
+	CellSize = FMath::Max(InCellSize, 1.0f);
+	NumCellsX = FMath::Max(1, FMath::CeilToInt(ViewportSize.X / CellSize));
+	NumCellsY = FMath::Max(1, FMath::CeilToInt(ViewportSize.Y / CellSize));
+	FrameNumber = InFrameNumber;
+	bIsBuilt = true;
+
+	const int32 NumCells = NumCellsX * NumCellsY;
+
+	// Counting sort of entries by cell
+	TArray<int32, TInlineAllocator<64>> EntryCells;
+	EntryCells.SetNumUninitialized(Entries.Num());
+	CellStarts.Reset();
+	CellStarts.SetNumZeroed(NumCells + 1);
+
+	for (int32 Index = 0; Index < Entries.Num(); Index++)
+	{
+		const FIntPoint Cell = GetCell(Entries[Index].ScreenLocation);
+		EntryCells[Index] = Cell.Y * NumCellsX + Cell.X;
+		CellStarts[EntryCells[Index] + 1]++;
+	}
+
+	for (int32 CellIndex = 0; CellIndex < NumCells; CellIndex++)
+	{
+		CellStarts[CellIndex + 1] += CellStarts[CellIndex];
+	}
+
+	TArray<int32> CellCursors(CellStarts.GetData(), NumCells);
+	CellEntries.SetNumUninitialized(Entries.Num());
+	for (int32 Index = 0; Index < Entries.Num(); Index++)
+	{
+		CellEntries[CellCursors[EntryCells[Index]]++] = Index;
+	}
+}
+
+void FTargetSystemScreenGrid::Reset()
+{
+	Entries.Reset();
+	CellEntries.Reset();
+	CellStarts.Reset();
+	bIsBuilt = false;
+}
+
+int32 FTargetSystemScreenGrid::FindNearest(const FVector2D& Point, const float MaxDistance, const TBitArray<>& ExcludedEntries) const
+{
+	if (!bIsBuilt || Entries.Num() == 0)
+	{
+		return INDEX_NONE;
+	}
+
+	const FIntPoint Center = GetCell(Point);
+	const int32 MaxRing = FMath::Max(NumCellsX, NumCellsY);
+
+	int32 BestIndex = INDEX_NONE;
+	float BestDistanceSquared = MaxDistance > 0.0f ? FMath::Square(MaxDistance) : TNumericLimits<float>::Max();
+
+	for (int32 Ring = 0; Ring <= MaxRing; Ring++)
+	{
+		// Every entry in this ring is at least (Ring - 1) cells away from Point
+		if (Ring > 0 && FMath::Square((Ring - 1) * CellSize) > BestDistanceSquared)
+		{
+			break;
+		}
+
+		ForEachCellInRing(Center, Ring, [&](const int32 CellIndex)
+		{
+			for (int32 CellEntry = CellStarts[CellIndex]; CellEntry < CellStarts[CellIndex + 1]; CellEntry++)
+			{
+				const int32 Index = CellEntries[CellEntry];
+				if (ExcludedEntries.IsValidIndex(Index) && ExcludedEntries[Index])
+				{
+					continue;
+				}
+
+				const float DistanceSquared = FVector2D::DistSquared(Point, Entries[Index].ScreenLocation);
+				if (DistanceSquared < BestDistanceSquared)
+				{
+					BestDistanceSquared = DistanceSquared;
+					BestIndex = Index;
+				}
+			}
+		});
+	}
+
+	return BestIndex;
+}
+
+int32 FTargetSystemScreenGrid::FindInDirection(const FVector2D& Origin, const FVector2D& Direction, const float MaxAngleDegrees, const TBitArray<>& ExcludedEntries) const
+{
+	const FVector2D SafeDirection = Direction.GetSafeNormal();
+	if (!bIsBuilt || Entries.Num() == 0 || SafeDirection.IsZero())
+	{
+		return INDEX_NONE;
+	}
+
+	const float MinCosAngle = FMath::Cos(FMath::DegreesToRadians(FMath::Clamp(MaxAngleDegrees, 0.0f, 180.0f)));
+	const FIntPoint Center = GetCell(Origin);
+	const int32 MaxRing = FMath::Max(NumCellsX, NumCellsY);
+
+	int32 BestIndex = INDEX_NONE;
+	float BestScore = TNumericLimits<float>::Max();
+
+	for (int32 Ring = 0; Ring <= MaxRing; Ring++)
+	{
+		// Score is never lower than the distance to Origin, which is at least (Ring - 1) cells in this ring
+		if (Ring > 0 && (Ring - 1) * CellSize > BestScore)
+		{
+			break;
+		}
+
+		ForEachCellInRing(Center, Ring, [&](const int32 CellIndex)
+		{
+			for (int32 CellEntry = CellStarts[CellIndex]; CellEntry < CellStarts[CellIndex + 1]; CellEntry++)
+			{
+				const int32 Index = CellEntries[CellEntry];
+				if (ExcludedEntries.IsValidIndex(Index) && ExcludedEntries[Index])
+				{
+					continue;
+				}
+
+				const FVector2D Offset = Entries[Index].ScreenLocation - Origin;
+				const float Distance = Offset.Size();
+				if (Distance <= UE_KINDA_SMALL_NUMBER)
+				{
+					continue;
+				}
+
+				const float Along = FVector2D::DotProduct(Offset, SafeDirection);
+				if (Along <= 0.0f || Along / Distance < MinCosAngle)
+				{
+					continue;
+				}
+
+				const float Across = FMath::Abs(FVector2D::CrossProduct(SafeDirection, Offset));
+				const float Score = Along + 2.0f * Across;
+				if (Score < BestScore)
+				{
+					BestScore = Score;
+					BestIndex = Index;
+				}
+			}
+		});
+	}
+
+	return BestIndex;
+}
+
+FIntPoint FTargetSystemScreenGrid::GetCell(const FVector2D& ScreenLocation) const
+{
+	return FIntPoint(
+		FMath::Clamp(FMath::FloorToInt(ScreenLocation.X / CellSize), 0, NumCellsX - 1),
+		FMath::Clamp(FMath::FloorToInt(ScreenLocation.Y / CellSize), 0, NumCellsY - 1)
+	);
+}
+
+template <typename FunctorType>
+void FTargetSystemScreenGrid::ForEachCellInRing(const FIntPoint& Center, const int32 Ring, FunctorType&& Functor) const
+{
+	const int32 MinX = Center.X - Ring;
+	const int32 MaxX = Center.X + Ring;
+	const int32 MinY = Center.Y - Ring;
+	const int32 MaxY = Center.Y + Ring;
+
+	const int32 ClampedMinX = FMath::Max(MinX, 0);
+	const int32 ClampedMaxX = FMath::Min(MaxX, NumCellsX - 1);
+
+	for (int32 Y = FMath::Max(MinY, 0); Y <= FMath::Min(MaxY, NumCellsY - 1); Y++)
+	{
+		if (Y == MinY || Y == MaxY)
+		{
+			// Top and bottom rows of the ring
+			for (int32 X = ClampedMinX; X <= ClampedMaxX; X++)
+			{
+				Functor(Y * NumCellsX + X);
+			}
+		}
+		else
+		{
+			// Left and right columns of the ring
+			if (MinX >= 0)
+			{
+				Functor(Y * NumCellsX + MinX);
+			}
+
+			if (MaxX < NumCellsX)
+			{
+				Functor(Y * NumCellsX + MaxX);
+			}
+		}
+	}
+}
@@ -0,0 +1,351 @@
+// Copyright 2018-2021 Mickael Daniel. All Rights Reserved.
+
+#include "TargetSystemSoakCommandlet.h"
+#include "TargetSystemComponent.h"
+#include "TargetSystemLog.h"
+#include "AIController.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "GameFramework/DefaultPawn.h"
+#include "GameFramework/WorldSettings.h"
+#include "HAL/PlatformMemory.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "UObject/Package.h"
+#include "UObject/UObjectArray.h"
+
+UTargetSystemSoakCommandlet::UTargetSystemSoakCommandlet()
+{
+	IsClient = false;
+	IsEditor = true;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UTargetSystemSoakCommandlet::Main(const FString& Params)
+{
+	FString MapName;
+	if (!FParse::Value(*Params, TEXT("Map="), MapName))
+	{
+		TS_LOG(Error, TEXT("TargetSystemSoak: Missing -Map=/Game/Path/To/Map argument"));
+		return 1;
+	}
+
+	int32 NumCycles = 5000;
+	int32 NumPawns = 16;
+	int32 SampleEvery = 50;
+	float Spacing = 300.0f;
+	float DeltaSeconds = 1.0f / 30.0f;
+	FString PawnClassPath;
+	FString OutputFilename = FPaths::ProjectSavedDir() / TEXT("TargetSystem") / TEXT("SoakTest.csv");
+
+	FParse::Value(*Params, TEXT("Cycles="), NumCycles);
+	FParse::Value(*Params, TEXT("Pawns="), NumPawns);
+	FParse::Value(*Params, TEXT("SampleEvery="), SampleEvery);
+	FParse::Value(*Params, TEXT("Spacing="), Spacing);
+	FParse::Value(*Params, TEXT("DeltaSeconds="), DeltaSeconds);
+	FParse::Value(*Params, TEXT("PawnClass="), PawnClassPath);
+	FParse::Value(*Params, TEXT("Output="), OutputFilename);
+
+	NumCycles = FMath::Max(NumCycles, 1);
+	NumPawns = FMath::Max(NumPawns, 2);
+	SampleEvery = FMath::Max(SampleEvery, 1);
+
+	UClass* PawnClass = ADefaultPawn::StaticClass();
+	if (!PawnClassPath.IsEmpty())
+	{
+		PawnClass = LoadClass<APawn>(nullptr, *PawnClassPath);
+		if (!PawnClass)
+		{
+			TS_LOG(Error, TEXT("TargetSystemSoak: Cannot load pawn class %s"), *PawnClassPath);
+			return 1;
+		}
+	}
+
+	UWorld* World = LoadWorld(MapName);
+	if (!World)
+	{
+		TS_LOG(Error, TEXT("TargetSystemSoak: Cannot load map %s"), *MapName);
+		return 1;
+	}
+
+	const TArray<UTargetSystemComponent*> Components = SpawnPawns(World, PawnClass, NumPawns, Spacing);
+	TS_LOG(Display, TEXT("TargetSystemSoak: Running %d cycles on %d pawns in %s"), NumCycles, Components.Num(), *MapName);
+
+	TArray<FSample> Samples;
+	Samples.Reserve(NumCycles / SampleEvery + 2);
+
+	const double StartTime = FPlatformTime::Seconds();
+	Samples.Add(TakeSample(0, StartTime, 0.0, 0.0));
+
+	double CycleTime = 0.0;
+	double TickTime = 0.0;
+	for (int32 Cycle = 1; Cycle <= NumCycles; Cycle++)
+	{
+		double CycleTickTime = 0.0;
+		CycleTime += RunCycle(World, Components, Cycle, DeltaSeconds, CycleTickTime);
+		TickTime += CycleTickTime;
+
+		if (Cycle % SampleEvery == 0 || Cycle == NumCycles)
+		{
+			const int32 NumSampledCycles = Cycle - Samples.Last().Cycle;
+			Samples.Add(TakeSample(Cycle, StartTime, CycleTime / NumSampledCycles, TickTime / NumSampledCycles));
+			CycleTime = 0.0;
+			TickTime = 0.0;
+
+			const FSample& Sample = Samples.Last();
+			TS_LOG(Display, TEXT("TargetSystemSoak: Cycle %d/%d - UObjects: %d, Forced purge: %.2fms, Cycle: %.3fms"),
+				Cycle,
+				NumCycles,
+				Sample.NumObjects,
+				Sample.ForcedPurgeTime * 1000.0,
+				Sample.CycleTime * 1000.0
+			);
+		}
+	}
+
+	DestroyWorld(World);
+
+	if (!WriteCsv(OutputFilename, Samples))
+	{
+		TS_LOG(Error, TEXT("TargetSystemSoak: Cannot write %s"), *OutputFilename);
+		return 1;
+	}
+
+	TS_LOG(Display, TEXT("TargetSystemSoak: Wrote %d samples to %s"), Samples.Num(), *OutputFilename);
+
+	// First samples include one time allocations (lock points cache, widget classes, ...)
+	const int32 WarmupSamples = Samples.Num() / 10;
+
+	uint64 EarlyMin = 0;
+	uint64 LateMin = 0;
+	if (IsSustainedGrowth(Samples, WarmupSamples, [](const FSample& Sample) { return static_cast<uint64>(Sample.UsedPhysicalMemory); }, EarlyMin, LateMin))
+	{
+		TS_LOG(Warning, TEXT("TargetSystemSoak: Lowest used physical memory grew over the samples (%.1fMB -> %.1fMB)"),
+			EarlyMin / (1024.0 * 1024.0),
+			LateMin / (1024.0 * 1024.0)
+		);
+	}
+
+	if (IsSustainedGrowth(Samples, WarmupSamples, [](const FSample& Sample) { return static_cast<uint64>(Sample.NumObjects); }, EarlyMin, LateMin))
+	{
+		TS_LOG(Error, TEXT("TargetSystemSoak: Lowest UObject count grew over the samples (%llu -> %llu), something is leaking"),
+			EarlyMin,
+			LateMin
+		);
+		return 1;
+	}
+
+	return 0;
+}
+
+UWorld* UTargetSystemSoakCommandlet::LoadWorld(const FString& MapName) const
+{
+	UPackage* Package = LoadPackage(nullptr, *MapName, LOAD_None);
+	UWorld* World = Package ? UWorld::FindWorldInPackage(Package) : nullptr;
+	if (!World)
+	{
+		return nullptr;
+	}
+
+	World->AddToRoot();
+	World->WorldType = EWorldType::Game;
+
+	FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	WorldContext.SetCurrentWorld(World);
+
+	if (!World->bIsWorldInitialized)
+	{
+		World->InitWorld(UWorld::InitializationValues()
+			.AllowAudioPlayback(false)
+			.RequiresHitProxies(false)
+			.CreatePhysicsScene(true)
+			.CreateNavigation(false)
+			.CreateAISystem(false)
+			.ShouldSimulatePhysics(false)
+			.EnableTraceCollision(true)
+			.SetTransactional(false)
+			.CreateFXSystem(false)
+		);
+	}
+
+	World->UpdateWorldComponents(true, true);
+
+	const FURL URL;
+	World->InitializeActorsForPlay(URL);
+	World->BeginPlay();
+
+	// Without a Game Mode (no Game Instance in a commandlet), actors are not told to begin play
+	if (!World->HasBegunPlay())
+	{
+		World->GetWorldSettings()->NotifyBeginPlay();
+	}
+
+	return World;
+}
+
+void UTargetSystemSoakCommandlet::DestroyWorld(UWorld* World) const
+{
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(false);
+	World->RemoveFromRoot();
+
+	CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+}
+
+TArray<UTargetSystemComponent*> UTargetSystemSoakCommandlet::SpawnPawns(UWorld* World, UClass* PawnClass, const int32 NumPawns, const float Spacing) const
+{
+	TArray<UTargetSystemComponent*> Components;
+	Components.Reserve(NumPawns);
+
+	// Square grid around the world origin, so that every pawn has neighbours in range
+	const int32 NumColumns = FMath::CeilToInt(FMath::Sqrt(static_cast<float>(NumPawns)));
+	const FVector Origin(-0.5f * Spacing * (NumColumns - 1), -0.5f * Spacing * (NumColumns - 1), 100.0f);
+
+	FActorSpawnParameters SpawnParameters;
+	SpawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+	for (int32 Index = 0; Index < NumPawns; Index++)
+	{
+		const FVector Location = Origin + FVector(Spacing * (Index % NumColumns), Spacing * (Index / NumColumns), 0.0f);
+		APawn* Pawn = World->SpawnActor<APawn>(PawnClass, Location, FRotator::ZeroRotator, SpawnParameters);
+		if (!Pawn)
+		{
+			continue;
+		}
+
+		// Possessed by an AI Controller, so that pawns are locally controlled and lock on widgets are created
+		Pawn->AIControllerClass = AAIController::StaticClass();
+		Pawn->SpawnDefaultController();
+
+		UTargetSystemComponent* Component = Pawn->FindComponentByClass<UTargetSystemComponent>();
+		if (!Component)
+		{
+			Component = NewObject<UTargetSystemComponent>(Pawn, TEXT("TargetSystem"));
+			Component->MinimumDistanceToEnable = Spacing * (NumColumns + 1);
+			Component->RegisterComponent();
+		}
+
+		Components.Add(Component);
+	}
+
+	return Components;
+}
+
+double UTargetSystemSoakCommandlet::RunCycle(UWorld* World, const TArray<UTargetSystemComponent*>& Components, const int32 Cycle, const float DeltaSeconds, double& OutTickTime) const
+{
+	double CycleTime = 0.0;
+	OutTickTime = 0.0;
+
+	const auto TickWorld = [World, DeltaSeconds, &OutTickTime]()
+	{
+		const double StartTime = FPlatformTime::Seconds();
+		World->Tick(LEVELTICK_All, DeltaSeconds);
+		OutTickTime += FPlatformTime::Seconds() - StartTime;
+	};
+
+	const auto ForEachComponent = [&Components, &CycleTime](TFunctionRef<void(UTargetSystemComponent*)> Function)
+	{
+		const double StartTime = FPlatformTime::Seconds();
+		for (UTargetSystemComponent* Component : Components)
+		{
+			if (IsValid(Component))
+			{
+				Function(Component);
+			}
+		}
+		CycleTime += FPlatformTime::Seconds() - StartTime;
+	};
+
+	// Lock on
+	ForEachComponent([](UTargetSystemComponent* Component)
+	{
+		if (!Component->IsLocked())
+		{
+			Component->TargetActor();
+		}
+	});
+	TickWorld();
+
+	// Switch, alternating left and right
+	const float AxisValue = Cycle % 2 == 0 ? 1.0f : -1.0f;
+	ForEachComponent([AxisValue](UTargetSystemComponent* Component)
+	{
+		Component->TargetActorWithAxisInput(AxisValue);
+	});
+	TickWorld();
+
+	// Lock off
+	ForEachComponent([](UTargetSystemComponent* Component)
+	{
+		if (Component->IsLocked())
+		{
+			Component->TargetLockOff();
+		}
+	});
+	TickWorld();
+
+	return CycleTime;
+}
+
+UTargetSystemSoakCommandlet::FSample UTargetSystemSoakCommandlet::TakeSample(const int32 Cycle, const double StartTime, const double CycleTime, const double TickTime) const
+{
+	FSample Sample;
+	Sample.Cycle = Cycle;
+	Sample.CycleTime = CycleTime;
+	Sample.TickTime = TickTime;
+
+	// Full purge, so that only objects still referenced are counted
+	const double PurgeStartTime = FPlatformTime::Seconds();
+	CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS, true);
+	Sample.ForcedPurgeTime = FPlatformTime::Seconds() - PurgeStartTime;
+
+	Sample.Time = FPlatformTime::Seconds() - StartTime;
+	Sample.NumObjects = GUObjectArray.GetObjectArrayNumMinusAvailable();
+	Sample.UsedPhysicalMemory = FPlatformMemory::GetStats().UsedPhysical;
+
+	return Sample;
+}
+
+bool UTargetSystemSoakCommandlet::WriteCsv(const FString& Filename, const TArray<FSample>& Samples)
+{
+	FString Csv = TEXT("Cycle,TimeSeconds,UObjects,UsedPhysicalMB,ForcedPurgeMs,CycleLatencyMs,TickTimeMs\n");
+	for (const FSample& Sample : Samples)
+	{
+		Csv += FString::Printf(TEXT("%d,%.3f,%d,%.2f,%.3f,%.4f,%.4f\n"),
+			Sample.Cycle,
+			Sample.Time,
+			Sample.NumObjects,
+			static_cast<double>(Sample.UsedPhysicalMemory) / (1024.0 * 1024.0),
+			Sample.ForcedPurgeTime * 1000.0,
+			Sample.CycleTime * 1000.0,
+			Sample.TickTime * 1000.0
+		);
+	}
+
+	return FFileHelper::SaveStringToFile(Csv, *Filename);
+}
+
+bool UTargetSystemSoakCommandlet::IsSustainedGrowth(const TArray<FSample>& Samples, const int32 WarmupSamples, TFunctionRef<uint64(const FSample&)> GetValue, uint64& OutEarlyMin, uint64& OutLateMin)
+{
+	OutEarlyMin = 0;
+	OutLateMin = 0;
+
+	// Not enough samples to tell growth from noise
+	const int32 NumSamples = Samples.Num() - WarmupSamples;
+	if (NumSamples < 4)
+	{
+		return false;
+	}
+
+	const int32 WindowSize = NumSamples / 4;
+	OutEarlyMin = TNumericLimits<uint64>::Max();
+	OutLateMin = TNumericLimits<uint64>::Max();
+	for (int32 Index = 0; Index < WindowSize; Index++)
+	{
+		OutEarlyMin = FMath::Min(OutEarlyMin, GetValue(Samples[WarmupSamples + Index]));
+		OutLateMin = FMath::Min(OutLateMin, GetValue(Samples[Samples.Num() - WindowSize + Index]));
+	}
+
+	return OutLateMin > OutEarlyMin;
+}
@@ -0,0 +1,307 @@
+// Copyright 2018-2021 Mickael Daniel. All Rights Reserved.
+
+#include "TargetSystemSubsystem.h"
+#include "TargetSystemTargetableInterface.h"
+#include "Components/MeshComponent.h"
+#include "Engine/Level.h"
+#include "Engine/World.h"
+#include "GameFramework/Actor.h"
+#include "HAL/IConsoleManager.h"
+
+namespace TargetSystem
+{
+	static float RegistryTimeBudgetMs = 0.5f;
+	static FAutoConsoleVariableRef CVarRegistryTimeBudgetMs(
+		TEXT("TargetSystem.RegistryTimeBudgetMs"),
+		RegistryTimeBudgetMs,
+		TEXT("Time (in milliseconds) spent per frame registering actors of levels streamed in, for the Registry candidate source.")
+	);
+
+	// Number of actors checked between two checks of the time budget
+	static constexpr int32 RegistryBatchSize = 64;
+}
+
+void UTargetSystemSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	// Also broadcast for World Partition cells, which are streamed in and out as levels
+	LevelAddedToWorldHandle = FWorldDelegates::LevelAddedToWorld.AddUObject(this, &UTargetSystemSubsystem::OnLevelAddedToWorld);
+	LevelRemovedFromWorldHandle = FWorldDelegates::LevelRemovedFromWorld.AddUObject(this, &UTargetSystemSubsystem::OnLevelRemovedFromWorld);
+	ActorSpawnedHandle = GetWorld()->AddOnActorSpawnedHandler(FOnActorSpawned::FDelegate::CreateUObject(this, &UTargetSystemSubsystem::OnActorSpawned));
+}
+
+void UTargetSystemSubsystem::Deinitialize()
+{
+	FWorldDelegates::LevelAddedToWorld.Remove(LevelAddedToWorldHandle);
+	FWorldDelegates::LevelRemovedFromWorld.Remove(LevelRemovedFromWorldHandle);
+	GetWorld()->RemoveOnActorSpawnedHandler(ActorSpawnedHandle);
+
+	LevelTargets.Reset();
+	PendingLevels.Reset();
+
+	Super::Deinitialize();
+}
+
+void UTargetSystemSubsystem::Tick(const float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	if (PendingLevels.Num() > 0)
+	{
+		ProcessPendingLevels(TargetSystem::RegistryTimeBudgetMs / 1000.0);
+	}
+	else
+	{
+		LastRegistryTickStats = FTargetSystemRegistryTickStats();
+	}
+}
+
+TStatId UTargetSystemSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UTargetSystemSubsystem, STATGROUP_Tickables);
+}
+
+void UTargetSystemSubsystem::NotifyTargetableChanged(AActor* TargetActor)
+{
+	if (!IsValid(TargetActor))
+	{
+		return;
+	}
+
+	OnTargetableChanged.Broadcast(TargetActor);
+}
+
+TConstArrayView<FTargetSystemLockPoint> UTargetSystemSubsystem::GetLockPoints(const AActor* Actor)
+{
+	check(Actor);
+
+	UClass* Class = Actor->GetClass();
+	if (const TArray<FTargetSystemLockPoint>* ClassLockPoints = LockPoints.Find(Class))
+	{
+		return *ClassLockPoints;
+	}
+
+	TArray<FTargetSystemLockPoint> ClassLockPoints;
+	if (Class->ImplementsInterface(UTargetSystemTargetableInterface::StaticClass()))
+	{
+		ClassLockPoints = ITargetSystemTargetableInterface::Execute_GetLockPoints(Class->GetDefaultObject());
+	}
+
+	if (ClassLockPoints.Num() == 0)
+	{
+		ClassLockPoints.AddDefaulted();
+	}
+
+	// Arrays keep their allocation when the map grows, so views of other classes stay valid
+	return LockPoints.Add(Class, MoveTemp(ClassLockPoints));
+}
+
+USceneComponent* UTargetSystemSubsystem::FindLockPointComponent(const AActor* Actor, const FTargetSystemLockPoint& LockPoint)
+{
+	if (LockPoint.ComponentName != NAME_None)
+	{
+		for (UActorComponent* Component : Actor->GetComponents())
+		{
+			if (Component && Component->GetFName() == LockPoint.ComponentName)
+			{
+				return Cast<USceneComponent>(Component);
+			}
+		}
+
+		return nullptr;
+	}
+
+	if (LockPoint.SocketName != NAME_None)
+	{
+		if (UMeshComponent* MeshComponent = Actor->FindComponentByClass<UMeshComponent>())
+		{
+			return MeshComponent;
+		}
+	}
+
+	return Actor->GetRootComponent();
+}
+
+FVector UTargetSystemSubsystem::GetLockPointLocation(const AActor* Actor, const USceneComponent* Component, const FTargetSystemLockPoint& LockPoint)
+{
+	if (!Component)
+	{
+		return Actor->GetActorLocation();
+	}
+
+	return LockPoint.SocketName != NAME_None ? Component->GetSocketLocation(LockPoint.SocketName) : Component->GetComponentLocation();
+}
+
+void UTargetSystemSubsystem::RegisterTargetableClass(const TSubclassOf<AActor> ActorClass)
+{
+	UClass* Class = ActorClass ? *ActorClass : AActor::StaticClass();
+
+	const bool bIsRegistered = TargetableClasses.ContainsByPredicate([Class](const UClass* TargetableClass)
+	{
+		return Class->IsChildOf(TargetableClass);
+	});
+
+	if (bIsRegistered)
+	{
+		return;
+	}
+
+	// Subclasses of the new class are redundant from now on
+	TargetableClasses.RemoveAll([Class](const UClass* TargetableClass)
+	{
+		return TargetableClass->IsChildOf(Class);
+	});
+
+	TargetableClasses.Add(Class);
+
+	// Loaded levels are registered again with the new class. Pending ones start over, as actors they already went
+	// through were not checked against it.
+	for (ULevel* Level : GetWorld()->GetLevels())
+	{
+		if (Level && Level->bIsVisible)
+		{
+			QueueLevel(Level);
+		}
+	}
+}
+
+int32 UTargetSystemSubsystem::GetNumRegisteredTargets() const
+{
+	int32 NumTargets = 0;
+	for (const TPair<TObjectKey<ULevel>, TArray<TWeakObjectPtr<AActor>>>& Pair : LevelTargets)
+	{
+		NumTargets += Pair.Value.Num();
+	}
+
+	return NumTargets;
+}
+
+int32 UTargetSystemSubsystem::GetNumPendingLevels() const
+{
+	return PendingLevels.Num();
+}
+
+const FTargetSystemRegistryTickStats& UTargetSystemSubsystem::GetLastRegistryTickStats() const
+{
+	return LastRegistryTickStats;
+}
+
+bool UTargetSystemSubsystem::IsTargetableClass(const AActor* Actor) const
+{
+	return IsValid(Actor) && TargetableClasses.ContainsByPredicate([Actor](const UClass* TargetableClass)
+	{
+		return Actor->IsA(TargetableClass);
+	});
+}
+
+void UTargetSystemSubsystem::QueueLevel(ULevel* Level)
+{
+	// Actors already registered for the level stay registered until it is done
+	PendingLevels.RemoveAll([Level](const FPendingLevel& PendingLevel)
+	{
+		return PendingLevel.Level == Level;
+	});
+
+	PendingLevels.Add({ Level, 0, {} });
+}
+
+int32 UTargetSystemSubsystem::ProcessPendingLevels(const double TimeBudget)
+{
+	const double StartTime = FPlatformTime::Seconds();
+	FTargetSystemRegistryTickStats& Stats = LastRegistryTickStats;
+	Stats = FTargetSystemRegistryTickStats();
+
+	while (PendingLevels.Num() > 0)
+	{
+		FPendingLevel& PendingLevel = PendingLevels[0];
+		ULevel* Level = PendingLevel.Level.Get();
+		if (!Level)
+		{
+			PendingLevels.RemoveAt(0);
+			continue;
+		}
+
+		const int32 NumActors = Level->Actors.Num();
+		while (PendingLevel.NextActorIndex < NumActors)
+		{
+			// Resume from there next frame. The first batch always runs, so that registration makes progress.
+			const double ElapsedTime = FPlatformTime::Seconds() - StartTime;
+			if (Stats.NumBatches > 0 && ElapsedTime >= TimeBudget)
+			{
+				Stats.Time = ElapsedTime;
+				return Stats.NumRegistered;
+			}
+
+			Stats.LastBatchStartTime = ElapsedTime;
+			Stats.NumBatches++;
+
+			const int32 EndIndex = FMath::Min(PendingLevel.NextActorIndex + TargetSystem::RegistryBatchSize, NumActors);
+			for (; PendingLevel.NextActorIndex < EndIndex; PendingLevel.NextActorIndex++)
+			{
+				AActor* Actor = Level->Actors[PendingLevel.NextActorIndex];
+				if (IsTargetableClass(Actor))
+				{
+					PendingLevel.Targets.Add(Actor);
+					Stats.NumRegistered++;
+				}
+			}
+		}
+
+		LevelTargets.Add(Level, MoveTemp(PendingLevel.Targets));
+		PendingLevels.RemoveAt(0);
+	}
+
+	Stats.Time = FPlatformTime::Seconds() - StartTime;
+	return Stats.NumRegistered;
+}
+
+void UTargetSystemSubsystem::OnLevelAddedToWorld(ULevel* Level, UWorld* World)
+{
+	if (Level && World == GetWorld() && TargetableClasses.Num() > 0)
+	{
+		QueueLevel(Level);
+	}
+}
+
+void UTargetSystemSubsystem::OnLevelRemovedFromWorld(ULevel* Level, UWorld* World)
+{
+	if (World != GetWorld())
+	{
+		return;
+	}
+
+	// Null when every level is removed (ex: world cleanup)
+	if (!Level)
+	{
+		LevelTargets.Reset();
+		PendingLevels.Reset();
+		return;
+	}
+
+	LevelTargets.Remove(Level);
+	PendingLevels.RemoveAll([Level](const FPendingLevel& PendingLevel)
+	{
+		return PendingLevel.Level == Level;
+	});
+}
+
+void UTargetSystemSubsystem::OnActorSpawned(AActor* Actor)
+{
+	if (!IsTargetableClass(Actor))
+	{
+		return;
+	}
+
+	// Actors spawned in a level being registered are appended to its actors, and will be registered with it
+	ULevel* Level = Actor->GetLevel();
+	const bool bIsPending = PendingLevels.ContainsByPredicate([Level](const FPendingLevel& PendingLevel)
+	{
+		return PendingLevel.Level == Level;
+	});
+
+	if (!bIsPending)
+	{
+		LevelTargets.FindOrAdd(Level).Add(Actor);
+	}
+}
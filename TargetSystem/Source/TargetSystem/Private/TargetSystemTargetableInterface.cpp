@@ -3,3 +3,8 @@
 #include "TargetSystemTargetableInterface.h"
 
 // Add default functionality here for any ITargetSystemTargetableInterface functions that are not pure virtual.
+
+TArray<FTargetSystemLockPoint> ITargetSystemTargetableInterface::GetLockPoints_Implementation() const
+{
+	return {};
+}
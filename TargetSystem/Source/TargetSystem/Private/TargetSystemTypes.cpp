@@ -0,0 +1,39 @@
+// Copyright 2018-2021 Mickael Daniel. All Rights Reserved.
+
+#include "TargetSystemTypes.h"
+#include "UObject/CoreNet.h"
+#include "GameFramework/Actor.h"
+
+bool FTargetSystemReplicatedLock::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess)
+{
+	uint8 Flags = 0;
+	if (Ar.IsSaving())
+	{
+		Flags = static_cast<uint8>((bIsLocked ? 1 : 0) | (FMath::Min(LockPointIndex, MaxLockPointIndex) << 1));
+	}
+
+	Ar << Flags;
+
+	if (Ar.IsLoading())
+	{
+		bIsLocked = (Flags & 1) != 0;
+		LockPointIndex = Flags >> 1;
+	}
+
+	bOutSuccess = true;
+	if (bIsLocked)
+	{
+		UObject* Object = Target;
+		bOutSuccess = Map->SerializeObject(Ar, AActor::StaticClass(), Object);
+		if (Ar.IsLoading())
+		{
+			Target = Cast<AActor>(Object);
+		}
+	}
+	else if (Ar.IsLoading())
+	{
+		Target = nullptr;
+	}
+
+	return true;
+}
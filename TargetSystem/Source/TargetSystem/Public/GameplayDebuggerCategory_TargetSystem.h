@@ -0,0 +1,66 @@
+// Copyright 2018-2021 Mickael Daniel. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#if WITH_GAMEPLAY_DEBUGGER
+
+#include "GameplayDebuggerCategory.h"
+
+class APlayerController;
+class AActor;
+
+/**
+ * Gameplay Debugger category showing the targeting decisions of the selected Pawn's UTargetSystemComponent.
+ *
+ * Displays the candidates of the last query with their rejection reason and score, the number of traces and the
+ * time spent in each phase. Data is collected on the server and replicated, so AI owned components can be inspected
+ * from a client.
+ */
+class FGameplayDebuggerCategory_TargetSystem : public FGameplayDebuggerCategory
+{
+public:
+	FGameplayDebuggerCategory_TargetSystem();
+
+	virtual void CollectData(APlayerController* OwnerPC, AActor* DebugActor) override;
+	virtual void DrawData(APlayerController* OwnerPC, FGameplayDebuggerCanvasContext& CanvasContext) override;
+
+	static TSharedRef<FGameplayDebuggerCategory> MakeInstance();
+
+protected:
+	struct FRepData
+	{
+		struct FCandidate
+		{
+			FString ActorName;
+			FVector Location = FVector::ZeroVector;
+			uint8 RejectReason = 0;
+			float Score = 0.0f;
+			bool bSelected = false;
+		};
+
+		FString ComponentName;
+		FString LockedOnTargetName;
+		bool bIsLocked = false;
+		int32 NumLineOfSightTracesAvoided = 0;
+		int32 NumRecentTargets = 0;
+
+		FString QueryName;
+		float QueryAge = 0.0f;
+		int32 NumTraces = 0;
+		int32 NumTracesAvoided = 0;
+		int32 NumVisibilityCacheHits = 0;
+		float GatherTimeMs = 0.0f;
+		float FilterTimeMs = 0.0f;
+		float ScoreTimeMs = 0.0f;
+
+		TArray<FCandidate> Candidates;
+
+		void Serialize(FArchive& Ar);
+	};
+
+	FRepData DataPack;
+};
+
+#endif // WITH_GAMEPLAY_DEBUGGER
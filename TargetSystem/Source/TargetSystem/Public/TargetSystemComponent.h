@@ -10,13 +10,27 @@
 #else
 #include "Engine/EngineTypes.h"
 #endif
+#include "TargetSystemTypes.h"
+#include "TargetSystemScreenGrid.h"
+#include "Async/Future.h"
 #include "TargetSystemComponent.generated.h"
 
 class UUserWidget;
 class UWidgetComponent;
+class USceneComponent;
+class UAIPerceptionComponent;
+class UTargetSystemSubsystem;
 class APlayerController;
+struct FTargetSystemAsyncQuery;
+struct FTargetSystemMultiLockState;
+struct FCollisionQueryParams;
+struct FTraceHandle;
+struct FTraceDatum;
 
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FComponentOnTargetLockedOnOff, AActor*, TargetActor);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FComponentOnTargetActorAsyncCompleted, AActor*, TargetActor);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FComponentOnTargetSlotLockedOnOff, AActor*, TargetActor, int32, SlotIndex);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FComponentOnTargetLockPointChanged, AActor*, TargetActor, int32, LockPointIndex);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FComponentSetRotation, AActor*, TargetActor, FRotator, ControlRotation);
 
 UCLASS(ClassGroup=(Custom), meta=(BlueprintSpawnableComponent))
@@ -24,6 +38,10 @@ class TARGETSYSTEM_API UTargetSystemComponent : public UActorComponent
 {
 	GENERATED_BODY()
 
+	friend class FTargetSystemBenchmarks;
+	friend class FTargetSystemNetworkTests;
+	friend class FTargetSystemComponentTests;
+
 public:
 	// Sets default values for this component's properties
 	UTargetSystemComponent();
@@ -39,6 +57,51 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Target System")
 	TEnumAsByte<ECollisionChannel> TargetableCollisionChannel;
 
+	// Where target queries get their candidates from.
+	//
+	// Set it to AIPerception for AI owners, to use actors perceived by the AI Perception Component of the owner (or its
+	// Controller) and skip line traces for the ones the Sight sense already sees.
+	//
+	// Set it to PhysicsOverlap in worlds with many actors, most of them out of range (see TargetSystem.BenchmarkGather).
+	// Targetable actors then need a component responding to TargetableCollisionChannel.
+	//
+	// Set it to Registry in large streamed worlds (level streaming or World Partition), to only iterate targetable
+	// actors of loaded levels, registered in batches as levels stream in and out.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Target System|Candidates")
+	ETargetSystemCandidateSource CandidateSource = ETargetSystemCandidateSource::ActorIterator;
+
+	// The maximum age (in seconds) of a successful Sight stimulus for a candidate to skip line traces.
+	//
+	// 0 means only actors currently in sight. Only used when CandidateSource is AIPerception.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Target System|Candidates", meta = (ClampMin = 0.0f))
+	float MaxSightStimulusAge = 0.0f;
+
+	// How TargetActor() and TargetActorWithAxisInput() pick a target.
+	//
+	// ClosestToCrosshair is meant for aim-assist style selection: the nearest lock point to the crosshair is locked on,
+	// and switching picks the nearest one on screen in the axis direction. TargetActorAsync() runs synchronously in
+	// this mode, see its documentation.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Target System|Selection")
+	ETargetSystemSelectionMode SelectionMode = ETargetSystemSelectionMode::ClosestToCharacter;
+
+	// The crosshair location on screen, normalized (0.5, 0.5 being the center of the viewport).
+	//
+	// Only used when SelectionMode is ClosestToCrosshair.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Target System|Selection")
+	FVector2D CrosshairScreenLocation = FVector2D(0.5f, 0.5f);
+
+	// The maximum distance from the crosshair to select a target, relative to the viewport height. 0 means anywhere on screen.
+	//
+	// Only used when SelectionMode is ClosestToCrosshair.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Target System|Selection", meta = (ClampMin = 0.0f))
+	float CrosshairSelectionRadius = 0.25f;
+
+	// The maximum angle (in degrees) on screen between the axis direction and a target to switch to it.
+	//
+	// Only used when SelectionMode is ClosestToCrosshair.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Target System|Selection", meta = (ClampMin = 0.0f, ClampMax = 180.0f))
+	float MaxScreenSwitchAngle = 60.0f;
+
 	// Whether or not the character rotation should be controlled when Target is locked on.
 	//
 	// If true, it'll set the value of bUseControllerRotationYaw and bOrientationToMovement variables on Target locked on / off.
@@ -51,10 +114,52 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Target System")
 	bool bIgnoreLookInput = true;
 
-	// The amount of time to break line of sight when actor gets behind an Object.
+	// Whether to check ITargetSystemTargetableInterface::IsTargetable() on the locked on target every frame.
+	//
+	// Targets can instead call UTargetSystemSubsystem::NotifyTargetableChanged() when their targetable state changes
+	// (ex: when they die), which locks off right away. Once every targetable actor does so, you can turn this off.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Target System")
+	bool bPollTargetable = true;
+
+	// The maximum amount of time (in seconds) between two distance checks against MinimumDistanceToEnable when locked on.
+	//
+	// The next check is otherwise scheduled from the owner and target maximum speeds, at the earliest time the target
+	// could get out of range.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Target System", meta = (ClampMin = 0.0f))
+	float MaxDistanceCheckInterval = 0.5f;
+
+	// Points of candidates tested for visibility, in order, stopping at the first one that can be line traced to.
+	//
+	// Order them by likelihood of being visible (ex: BoundsCenter, a head Socket, then BoundsTop), so that most candidates
+	// only need a single trace, while candidates whose pivot is behind low cover are still found. Samples resolving to
+	// the same location are only traced once. Empty means the LockPoint only.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Target System|Line of Sight")
+	TArray<FTargetSystemVisibilitySample> VisibilitySamples;
+
+	// Whether to use the render state of candidates to avoid line traces (only for owners controlled by a local player).
+	//
+	// Candidates on screen that were not rendered for RenderVisibilityTolerance are discarded as occluded without
+	// tracing, and the line of sight to a locked on target rendered this frame is not traced. Line traces are still used
+	// whenever render state is unknown (ex: never rendered, or no visible primitive).
+	//
+	// With local split screen, render state is shared by every view: disable it if players can see different targets.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Target System|Line of Sight")
+	bool bUseRenderVisibility = false;
+
+	// The amount of time (in seconds) a candidate on screen can go without being rendered before it is considered occluded.
+	//
+	// Only used when bUseRenderVisibility is true. Never less than two frames, as the renderer lags behind the game thread.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Target System|Line of Sight", meta = (ClampMin = 0.0f))
+	float RenderVisibilityTolerance = 0.2f;
+
+	// The amount of time to break line of sight when actor gets behind an Object (including other targetable actors).
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Target System")
 	float BreakLineOfSightDelay = 2.0f;
 
+	// The amount of time (in seconds) between two line of sight checks on the locked on target. 0 checks every frame.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Target System|Line of Sight", meta = (ClampMin = 0.0f))
+	float LineOfSightCheckInterval = 0.1f;
+
 	// Lower this value is, easier it will be to switch new target on right or left. Must be < 1.0f if controlling with gamepad stick
 	//
 	// When using Sticky Feeling feature, it has no effect (see StickyRotationThreshold)
@@ -134,10 +239,71 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Target System|Sticky Feeling on Target Switch")
 	float StickyRotationThreshold = 30.0f;
 
+	// Extra distance tolerated by the server when validating a lock on requested by a client, to account for latency.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Target System|Network", meta = (ClampMin = 0.0f))
+	float ServerLockOnDistanceTolerance = 100.0f;
+
+	// The maximum number of targets locked on at once when using MultiLockOn()
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Target System|Multi Lock", meta = (ClampMin = 1))
+	int32 MaxLockedTargets = 4;
+
+	// The amount of time (in seconds) between two updates of the locked on targets when using MultiLockOn()
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Target System|Multi Lock", meta = (ClampMin = 0.0f))
+	float MultiLockUpdateInterval = 0.1f;
+
+	// The amount of time (in seconds) between two gatherings of candidates when using MultiLockOn().
+	//
+	// Updates in between only re-score the candidates already gathered that moved, so new targets are picked up at this pace.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Target System|Multi Lock", meta = (ClampMin = 0.0f))
+	float MultiLockRescanInterval = 0.5f;
+
+	// Whether TargetActor() first tries to lock back on the most recently locked off target (ex: after a line of sight
+	// break, or after switching away from it), validated with a single line trace instead of a full target query.
+	//
+	// TargetActorAsync() makes that trace on the game thread, and only issues a request if it fails.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Target System|Recent Targets")
+	bool bPreferRecentTargets = false;
+
+	// Whether to lock back on automatically when regaining sight of a target whose lock was broken by losing line of
+	// sight, for as long as it is remembered (see RecentTargetMemoryDuration).
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Target System|Recent Targets")
+	bool bRelockOnRegainSight = false;
+
+	// The maximum number of recently locked off targets remembered. The oldest one is forgotten when full.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Target System|Recent Targets", meta = (ClampMin = 0))
+	int32 MaxRecentTargets = 4;
+
+	// The amount of time (in seconds) a locked off target is remembered.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Target System|Recent Targets", meta = (ClampMin = 0.0f))
+	float RecentTargetMemoryDuration = 5.0f;
+
+	// The amount of time (in seconds) between two line of sight checks on a lost target when bRelockOnRegainSight is true.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Target System|Recent Targets", meta = (ClampMin = 0.01f))
+	float RegainSightCheckInterval = 0.25f;
+
 	// Function to call to target a new actor.
 	UFUNCTION(BlueprintCallable, Category = "Target System")
 	void TargetActor();
 
+	/**
+	 * Same as TargetActor(), but filtering and scoring of candidates run on a worker thread and line traces are
+	 * issued asynchronously. The target is locked on, on the game thread, a frame or two later.
+	 *
+	 * Candidates are scored like TargetActor() with ClosestToCharacter: the nearest visible lock point is locked on,
+	 * and bPreferRecentTargets and bUseRenderVisibility apply. With SelectionMode set to ClosestToCrosshair, the
+	 * screen grid query runs synchronously instead (same as TargetActor()), and so does the recent target trace.
+	 *
+	 * Returned future and OnTargetActorAsyncCompleted are resolved with the locked on actor, or nullptr if none was
+	 * found, the request was superseded (by another request, TargetActor() or TargetLockOff()) or a target got locked
+	 * on another way in the meantime. Candidates that got destroyed, became untargetable or left range while the
+	 * request was in flight are never locked on. Synchronous cases resolve before returning.
+	 */
+	TFuture<TWeakObjectPtr<AActor>> TargetActorAsync();
+
+	// Function to call to target a new actor asynchronously. See OnTargetActorAsyncCompleted for the result.
+	UFUNCTION(BlueprintCallable, Category = "Target System", meta = (DisplayName = "Target Actor Async"))
+	void K2_TargetActorAsync();
+
 	// Function to call to manually untarget.
 	UFUNCTION(BlueprintCallable, Category = "Target System")
 	void TargetLockOff();
@@ -150,6 +316,17 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Target System")
 	void TargetActorWithAxisInput(float AxisValue);
 
+	/**
+	* Function to call to switch with controller stick movement, in any direction on screen.
+	*
+	* Switches to the nearest target on screen in the stick direction when SelectionMode is ClosestToCrosshair, and
+	* behaves like TargetActorWithAxisInput() with the X-Axis otherwise.
+	*
+	* @param StickInput Pass in the 2D value of your Input Axis (X pointing right, Y pointing up)
+	*/
+	UFUNCTION(BlueprintCallable, Category = "Target System")
+	void TargetActorWithStickInput(FVector2D StickInput);
+
 	// Function to get TargetLocked private variable status
 	UFUNCTION(BlueprintCallable, Category = "Target System")
 	bool GetTargetLockedStatus();
@@ -169,6 +346,10 @@ public:
 	UPROPERTY(BlueprintAssignable, Category = "Target System")
 	FComponentSetRotation OnTargetSetRotation;
 
+	// Called when a TargetActorAsync() request completes, with the locked on actor or nullptr
+	UPROPERTY(BlueprintAssignable, Category = "Target System")
+	FComponentOnTargetActorAsyncCompleted OnTargetActorAsyncCompleted;
+
 	// Returns the reference to currently targeted Actor if any
 	UFUNCTION(BlueprintCallable, Category = "Target System")
 	AActor* GetLockedOnTargetActor() const;
@@ -177,6 +358,66 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Target System")
 	bool IsLocked() const;
 
+	/**
+	 * Function to call to step to the next / previous lock point (see ITargetSystemTargetableInterface::GetLockPoints())
+	 * of the currently targeted Actor, without searching for a new target.
+	 *
+	 * @param Direction Positive to step to the next lock point, negative to step to the previous one
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Target System")
+	void SwitchLockPoint(int32 Direction = 1);
+
+	// Returns the index of the locked on point of the currently targeted Actor
+	UFUNCTION(BlueprintCallable, Category = "Target System")
+	int32 GetLockedOnPointIndex() const;
+
+	// Returns the world location of the locked on point of the currently targeted Actor
+	UFUNCTION(BlueprintCallable, Category = "Target System")
+	FVector GetLockedOnLocation() const;
+
+	// Called when stepping to another lock point of the currently targeted Actor
+	UPROPERTY(BlueprintAssignable, Category = "Target System")
+	FComponentOnTargetLockPointChanged OnTargetLockPointChanged;
+
+	/**
+	 * Starts maintaining up to MaxLockedTargets locked on targets (ex: for homing missiles), nearest first.
+	 *
+	 * Targets are kept in the same slot for as long as they stay among the nearest visible ones, and are updated every
+	 * MultiLockUpdateInterval. Visibility traces are issued asynchronously, so slots change a frame or two after each
+	 * update. This is independent from the single target locked on with TargetActor().
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Target System|Multi Lock")
+	void MultiLockOn();
+
+	// Releases every target locked on with MultiLockOn()
+	UFUNCTION(BlueprintCallable, Category = "Target System|Multi Lock")
+	void MultiLockOff();
+
+	// Returns true / false whether MultiLockOn() is active
+	UFUNCTION(BlueprintCallable, Category = "Target System|Multi Lock")
+	bool IsMultiLocked() const;
+
+	// Returns the targets locked on with MultiLockOn(), indexed by slot. Empty slots are null.
+	UFUNCTION(BlueprintCallable, Category = "Target System|Multi Lock")
+	TArray<AActor*> GetMultiLockedTargets() const;
+
+	// Called when a target is locked on in a multi lock slot
+	UPROPERTY(BlueprintAssignable, Category = "Target System|Multi Lock")
+	FComponentOnTargetSlotLockedOnOff OnTargetSlotLockedOn;
+
+	// Called when a target is released from a multi lock slot
+	UPROPERTY(BlueprintAssignable, Category = "Target System|Multi Lock")
+	FComponentOnTargetSlotLockedOnOff OnTargetSlotLockedOff;
+
+	// Returns the breakdown of the last target query (candidates, rejection reasons, trace count and timings)
+	const FTargetSystemQueryStats& GetLastQueryStats() const;
+
+	// Returns the number of line of sight checks on the locked on target that skipped their trace (see bUseRenderVisibility)
+	int32 GetNumLineOfSightTracesAvoided() const;
+
+	// Returns the recently locked off targets (see bPreferRecentTargets)
+	const FTargetSystemRecentTargets& GetRecentTargets() const;
+
 private:
 	UPROPERTY()
 	AActor* OwnerActor;
@@ -193,6 +434,11 @@ private:
 	UPROPERTY()
 	AActor* LockedOnTargetActor;
 
+	// Locked on point of LockedOnTargetActor, and its resolved component
+	int32 LockedOnPointIndex = 0;
+	FTargetSystemLockPoint LockedOnPoint;
+	TWeakObjectPtr<USceneComponent> LockedOnPointComponent;
+
 	FTimerHandle LineOfSightBreakTimerHandle;
 	FTimerHandle SwitchingTargetTimerHandle;
 
@@ -204,23 +450,203 @@ private:
 	bool bDesireToSwitch = false;
 	float StartRotatingStack = 0.0f;
 
+	// Sticky feeling of TargetActorWithStickInput(), accumulated per stick direction
+	FVector2D StickRotatingStack = FVector2D::ZeroVector;
+
+	// World time at which the distance to the locked on target should be checked again
+	double NextDistanceCheckTime = 0.0;
+
+	// World time at which the line of sight to the locked on target should be checked again
+	double NextLineOfSightCheckTime = 0.0;
+
+	FDelegateHandle OnTargetableChangedHandle;
+
+	// Server authoritative lock state, replicated to simulated proxies. Owning clients predict their own lock state.
+	UPROPERTY(ReplicatedUsing = OnRep_ReplicatedLock)
+	FTargetSystemReplicatedLock ReplicatedLock;
+
+	// Set while applying a lock change coming from the network, so that it isn't sent back
+	bool bIsHandlingNetworkLock = false;
+
+	// Targets locked on with MultiLockOn(), indexed by slot
+	UPROPERTY()
+	TArray<AActor*> LockedOnTargetSlots;
+
+	bool bIsMultiLocked = false;
+	double NextMultiLockUpdateTime = 0.0;
+
+	// Candidates heap and in flight visibility traces of MultiLockOn()
+	TSharedPtr<FTargetSystemMultiLockState> MultiLockState;
+
+	// In flight TargetActorAsync() request, if any
+	TSharedPtr<FTargetSystemAsyncQuery> PendingAsyncQuery;
+	uint32 LastAsyncQueryId = 0;
+
+	// Only recorded while TargetActor() / TargetActorWithAxisInput() are running, and ShouldRecordQueryStats()
+	mutable FTargetSystemQueryStats LastQueryStats;
+	bool bIsRecordingQuery = false;
+
+	// Platform time of the last GetLastQueryStats() call, recording stops a while after nobody reads them anymore
+	mutable double LastQueryStatsReadTime = -DBL_MAX;
+
+	// Candidates of the current query whose visibility is already known (ex: seen by AI Perception sight)
+	TSet<const AActor*> SightConfirmedCandidates;
+
+	mutable int32 NumLineOfSightTracesAvoided = 0;
+
+	// Recently locked off targets, and the timer polling for lost ones coming back into sight
+	FTargetSystemRecentTargets RecentTargets;
+	FTimerHandle RegainSightTimerHandle;
+
 	//~ Actors search / trace
 
 	TArray<AActor*> GetAllActorsOfClass(TSubclassOf<AActor> ActorClass) const;
-	TArray<AActor*> FindTargetsInRange(TArray<AActor*> ActorsToLook, float RangeMin, float RangeMax) const;
 
-	AActor* FindNearestTarget(TArray<AActor*> Actors) const;
+	// Returns the actors overlapping a sphere of MinimumDistanceToEnable radius around the owner, on TargetableCollisionChannel
+	TArray<AActor*> GetOverlappingActors(TSubclassOf<AActor> ActorClass) const;
+
+	// Returns the candidates of a target query, from CandidateSource
+	TArray<AActor*> GatherCandidates();
+	TArray<AActor*> GetPerceivedActors(const UAIPerceptionComponent* PerceptionComponent);
+	TArray<AActor*> GetRegisteredActors(UTargetSystemSubsystem* Subsystem) const;
+	UAIPerceptionComponent* GetOwnerPerceptionComponent() const;
 
-	bool LineTrace(FHitResult& OutHitResult, const AActor* OtherActor, const TArray<AActor*>& ActorsToIgnore) const;
+	// Whether render state of candidates can be trusted for this owner (see bUseRenderVisibility)
+	bool ShouldUseRenderVisibility() const;
+
+	// Line traces to the candidate, unless visibility was already confirmed while gathering candidates, or render state shows it is occluded
+	bool HasLineOfSightToCandidate(const AActor* Actor, const FVector& TargetLocation, const TArray<AActor*>& ActorsToIgnore) const;
+
+	// Returns the nearest visible target, and which of its lock points is the nearest visible one
+	AActor* FindNearestTarget(TArray<AActor*> Actors, int32& OutLockPointIndex) const;
+
+	FCollisionQueryParams MakeLineTraceParams(const TArray<AActor*>& ActorsToIgnore) const;
 	bool LineTraceForActor(const AActor* OtherActor, const TArray<AActor*>& ActorsToIgnore) const;
+	bool LineTraceForActor(const AActor* OtherActor, const FVector& TargetLocation, const TArray<AActor*>& ActorsToIgnore) const;
+
+	// Nearest target around the character on the side of AxisValue, closest to the current target
+	AActor* FindTargetAroundCharacter(AActor* CurrentTarget, float AxisValue);
+
+	//~ Screen space selection
+
+	// Candidates lock points projected on screen, built at most once per frame
+	FTargetSystemScreenGrid ScreenGrid;
+
+	bool ShouldUseScreenGrid() const;
+	void UpdateScreenGrid();
+
+	AActor* FindTargetClosestToCrosshair(int32& OutLockPointIndex);
+	AActor* FindTargetInScreenDirection(AActor* CurrentTarget, const FVector2D& Direction, int32& OutLockPointIndex);
+
+	/**
+	 * Line traces to the VisibilitySamples of OtherActor in order, until one is visible. Results are cached for the frame.
+	 *
+	 * @param TargetLocation Location of the LockPoint sample
+	 * @param bNoHitIsVisible Whether a trace hitting nothing counts as visible (it only does when hitting OtherActor otherwise)
+	 */
+	bool TraceVisibilitySamples(const AActor* OtherActor, const FVector& TargetLocation, const FCollisionQueryParams& Params, bool bNoHitIsVisible) const;
+
+	// Returns the visibility sample at Index, the LockPoint when VisibilitySamples is empty
+	FTargetSystemVisibilitySample GetVisibilitySample(int32 Index) const;
+
+	// Visibility test results of the current frame
+	mutable TMap<FTargetSystemVisibilityCacheKey, bool> VisibilityCache;
+	mutable uint64 VisibilityCacheFrame = 0;
 
 	bool ShouldBreakLineOfSight() const;
 	void BreakLineOfSight();
 
+	//~ Recent targets
+
+	// Locks off, remembering the target as lost from sight
+	void LockOffFromLineOfSight();
+
+	/**
+	 * Returns the most recent remembered target still in range, on screen and targetable, if it can be line traced to.
+	 *
+	 * Only the most recent one passing these checks is traced, so that it costs a single trace.
+	 *
+	 * @param bLostSightOnly Whether to only consider targets whose lock was broken by losing line of sight
+	 */
+	AActor* FindRecentTarget(bool bLostSightOnly, int32& OutLockPointIndex);
+
+	void CheckRegainSight();
+
 	bool IsInViewport(const AActor* TargetActor) const;
+	bool IsInViewport(const FVector& Location) const;
 
 	float GetDistanceFromCharacter(const AActor* OtherActor) const;
 
+	//~ Lock invalidation
+
+	void BindToLockedOnTarget(AActor* TargetActor);
+	void UnbindFromLockedOnTarget();
+
+	// Locks off if the target is out of range, otherwise schedules the next check from the maximum speeds of owner and target
+	void UpdateDistanceCheck(double WorldTime);
+
+	static float GetMaxSpeed(const AActor* Actor);
+
+	UFUNCTION()
+	void OnLockedOnTargetDestroyed(AActor* DestroyedActor);
+
+	UFUNCTION()
+	void OnLockedOnTargetEndPlay(AActor* Actor, EEndPlayReason::Type EndPlayReason);
+
+	void OnTargetableChanged(AActor* TargetActor);
+
+	//~ Network
+
+	UFUNCTION(Server, Reliable)
+	void ServerRequestLockOn(AActor* TargetToLockOn, uint8 LockPointIndex);
+
+	UFUNCTION(Server, Reliable)
+	void ServerRequestLockOff();
+
+	// Sent to the owning client when the server rejects its predicted lock on, or releases the lock on its own
+	UFUNCTION(Client, Reliable)
+	void ClientLockOff(AActor* TargetToLockOff);
+
+	UFUNCTION()
+	void OnRep_ReplicatedLock();
+
+	// Validates a lock on requested by a client with a single trace to the requested lock point, instead of running a full target query
+	bool IsValidServerLockOn(const AActor* TargetToLockOn, int32 LockPointIndex) const;
+
+	// Notifies server or owning client of a lock change made locally
+	void OnLocalLockChanged(AActor* PreviousTarget);
+
+	bool IsOwnerLocallyControlled() const;
+
+	// Whether this instance runs targeting (invalidation, rotation, ...) or only mirrors the replicated lock state
+	bool CanRunLocalTargeting() const;
+
+	//~ Multi lock
+
+	// Re-scores the candidates that moved (or gathers them again) and traces the nearest ones, the slots being updated
+	// once traces complete
+	void UpdateMultiLock();
+
+	// Issues the next round of visibility traces (one sample per candidate), or applies the selection when slots are all
+	// filled
+	void IssueMultiLockTraces();
+	void OnMultiLockTraceCompleted(const FTraceHandle& TraceHandle, FTraceDatum& TraceDatum, uint32 BatchId);
+
+	// Locks on the visible candidates of the current update, keeping targets that are still selected in their slot
+	void ApplyMultiLockSelection();
+	void ReleaseTargetSlot(int32 SlotIndex);
+
+	// Ticking is needed for as long as a single or multi lock is active
+	void UpdateTickEnabled();
+
+	//~ Query stats
+
+	// Never in shipping builds, otherwise while the Gameplay Debugger reads the stats or TargetSystem.RecordQueryStats is set
+	bool ShouldRecordQueryStats() const;
+
+	void BeginQueryStats(FName QueryName);
+	void EndQueryStats(const AActor* SelectedActor);
+	void RecordCandidate(const AActor* Actor, ETargetSystemRejectReason RejectReason, float Score = 0.0f) const;
 
 	//~ Actor rotation
 
@@ -228,23 +654,38 @@ private:
 	void SetControlRotationOnTarget(AActor* TargetActor) const;
 	void ControlRotation(bool ShouldControlRotation) const;
 
-	float GetAngleUsingCameraRotation(const AActor* ActorToLook) const;
-	float GetAngleUsingCharacterRotation(const AActor* ActorToLook) const;
-
-	static FRotator FindLookAtRotation(const FVector Start, const FVector Target);
-
 	//~ Widget
 
 	void CreateAndAttachTargetLockedOnWidgetComponent(AActor* TargetActor);
 
 	//~ Targeting
 
-	void TargetLockOn(AActor* TargetToLockOn);
+	void TargetLockOn(AActor* TargetToLockOn, int32 LockPointIndex = 0);
+
+	//~ Lock points
+
+	TConstArrayView<FTargetSystemLockPoint> GetLockPoints(const AActor* Actor) const;
+	void SetLockedOnPoint(int32 LockPointIndex);
 	void ResetIsSwitchingTarget();
 	bool ShouldSwitchTargetActor(float AxisValue);
 
+	// Same as ShouldSwitchTargetActor(), with opposite stick directions cancelling each other out
+	bool ShouldSwitchTargetActorWithStick(const FVector2D& StickInput);
+
+	// Locks on ActorToTarget in place of the current target, preventing another switch for a while
+	void SwitchToTarget(AActor* ActorToTarget, int32 LockPointIndex);
+
 	static bool TargetIsTargetable(const AActor* Actor);
 
+	//~ Async targeting
+
+	void IssueAsyncTraces(const TSharedRef<FTargetSystemAsyncQuery>& Query);
+	void OnAsyncTraceCompleted(const FTraceHandle& TraceHandle, FTraceDatum& TraceDatum, uint32 QueryId);
+	void FinishAsyncQuery();
+
+	// Resolves the pending TargetActorAsync() request, if any, with the given actor
+	void CompleteAsyncQuery(AActor* SelectedActor);
+
 	/**
 	 *  Sets up cached Owner PlayerController from Owner Pawn.
 	 *
@@ -256,6 +697,10 @@ protected:
 	// Called when the game starts
 	virtual void BeginPlay() override;
 
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
 	// Called every frame
 	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
 };
@@ -0,0 +1,205 @@
+// Copyright 2018-2021 Mickael Daniel. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SceneView.h"
+#include "TargetSystemTypes.h"
+#include "Camera/CameraComponent.h"
+#include "Engine/GameViewportClient.h"
+#include "Engine/LocalPlayer.h"
+#include "GameFramework/Actor.h"
+#include "GameFramework/PlayerController.h"
+
+/**
+ * Per candidate filtering kernels of target queries.
+ *
+ * Kernels are templated on a policy type, so that the configuration of a query (ex: whether candidates are projected on
+ * screen) is resolved once per query with DispatchFilterCandidates(), instead of being branched on for every candidate.
+ */
+namespace TargetSystem
+{
+	// Snapshot of the owner's view, to project candidates on screen without going through the Player Controller (and
+	// from any thread)
+	struct FViewSnapshot
+	{
+		bool bIsValid = false;
+		FMatrix ViewProjectionMatrix = FMatrix::Identity;
+		FIntRect ViewRect;
+		FVector2D ViewportSize = FVector2D::ZeroVector;
+	};
+
+	inline FViewSnapshot CaptureView(const APlayerController* PlayerController)
+	{
+		FViewSnapshot View;
+
+		const ULocalPlayer* LocalPlayer = IsValid(PlayerController) ? PlayerController->GetLocalPlayer() : nullptr;
+		if (LocalPlayer && LocalPlayer->ViewportClient)
+		{
+			FSceneViewProjectionData ProjectionData;
+			if (LocalPlayer->GetProjectionData(LocalPlayer->ViewportClient->Viewport, ProjectionData))
+			{
+				View.ViewProjectionMatrix = ProjectionData.ComputeViewProjectionMatrix();
+				View.ViewRect = ProjectionData.GetConstrainedViewRect();
+				LocalPlayer->ViewportClient->GetViewportSize(View.ViewportSize);
+				View.bIsValid = true;
+			}
+		}
+
+		return View;
+	}
+
+	// Same as UTargetSystemComponent::IsInViewport(), from a snapshot view
+	inline bool IsOnScreen(const FViewSnapshot& View, const FVector& Location)
+	{
+		FVector2D ScreenLocation;
+		const bool bProjected = FSceneView::ProjectWorldToScreen(Location, View.ViewRect, View.ViewProjectionMatrix, ScreenLocation);
+		return bProjected && ScreenLocation.X > 0 && ScreenLocation.Y > 0 && ScreenLocation.X < View.ViewportSize.X && ScreenLocation.Y < View.ViewportSize.Y;
+	}
+
+	// Query configuration resolved at compile time
+	template <bool bInProjectOnScreen, bool bInFilterBySide>
+	struct TQueryPolicy
+	{
+		// Whether candidates off screen are rejected (only with a view, ie. for player controlled owners)
+		static constexpr bool ProjectOnScreen() { return bInProjectOnScreen; }
+
+		// Whether candidates outside of the [RangeMin, RangeMax] view angle are rejected (when switching target)
+		static constexpr bool FilterBySide() { return bInFilterBySide; }
+	};
+
+	// Query configuration resolved at runtime, branching for every candidate. Only used to benchmark specializations.
+	struct FRuntimeQueryPolicy
+	{
+		bool bProjectOnScreen = false;
+		bool bFilterBySide = false;
+
+		bool ProjectOnScreen() const { return bProjectOnScreen; }
+		bool FilterBySide() const { return bFilterBySide; }
+	};
+
+	// Per query state of the kernels, resolved once per query
+	struct FQueryKernelContext
+	{
+		FVector OwnerLocation = FVector::ZeroVector;
+		float MaxDistanceSquared = 0.0f;
+
+		// Location and yaw of the camera, or of the owner without camera, to compute side angles from
+		FVector ViewLocation = FVector::ZeroVector;
+		float ViewYaw = 0.0f;
+
+		// View angle range of FilterBySide() policies, in degrees (0 - 180 on the left, 180 - 360 on the right)
+		float RangeMin = 0.0f;
+		float RangeMax = 360.0f;
+
+		FViewSnapshot View;
+	};
+
+	inline FQueryKernelContext MakeQueryKernelContext(const AActor* OwnerActor, const APlayerController* PlayerController, const float MaxDistance)
+	{
+		FQueryKernelContext Context;
+		Context.OwnerLocation = OwnerActor->GetActorLocation();
+		Context.MaxDistanceSquared = FMath::Square(MaxDistance);
+
+		// Fallback to the character rotation if no Camera Component can be found
+		if (const UCameraComponent* CameraComponent = OwnerActor->FindComponentByClass<UCameraComponent>())
+		{
+			Context.ViewLocation = CameraComponent->GetComponentLocation();
+			Context.ViewYaw = CameraComponent->GetComponentRotation().Yaw;
+		}
+		else
+		{
+			Context.ViewLocation = Context.OwnerLocation;
+			Context.ViewYaw = OwnerActor->GetActorRotation().Yaw;
+		}
+
+		Context.View = CaptureView(PlayerController);
+		return Context;
+	}
+
+	// Angle between the view direction and the candidate, in [0, 360) degrees
+	inline float GetSideAngle(const FQueryKernelContext& Context, const FVector& Location)
+	{
+		const FVector Direction = Location - Context.ViewLocation;
+		const float LookAtYaw = FMath::RadiansToDegrees(FMath::Atan2(Direction.Y, Direction.X));
+
+		float YawAngle = Context.ViewYaw - LookAtYaw;
+		if (YawAngle < 0)
+		{
+			YawAngle = YawAngle + 360;
+		}
+
+		return YawAngle;
+	}
+
+	/**
+	 * Removes candidates out of range, off screen or on the wrong side, keeping the others in order.
+	 *
+	 * @param Policy TQueryPolicy (or FRuntimeQueryPolicy for the generic path)
+	 * @param Candidates Any type with Actor and Location members
+	 * @param OnRejected Called with each rejected candidate, its reject reason and a score (distance or angle)
+	 */
+	template <typename PolicyType, typename CandidateType, typename RejectFunctorType>
+	void FilterCandidates(const PolicyType& Policy, const FQueryKernelContext& Context, TArray<CandidateType>& Candidates, RejectFunctorType&& OnRejected)
+	{
+		int32 NumKept = 0;
+		for (int32 Index = 0; Index < Candidates.Num(); Index++)
+		{
+			const CandidateType& Candidate = Candidates[Index];
+
+			const float DistanceSquared = FVector::DistSquared(Context.OwnerLocation, Candidate.Location);
+			if (DistanceSquared >= Context.MaxDistanceSquared)
+			{
+				OnRejected(Candidate, ETargetSystemRejectReason::OutOfRange, FMath::Sqrt(DistanceSquared));
+				continue;
+			}
+
+			if (Policy.ProjectOnScreen() && !IsOnScreen(Context.View, Candidate.Location))
+			{
+				OnRejected(Candidate, ETargetSystemRejectReason::OffScreen, FMath::Sqrt(DistanceSquared));
+				continue;
+			}
+
+			if (Policy.FilterBySide())
+			{
+				const float Angle = GetSideAngle(Context, Candidate.Location);
+				if (Angle <= Context.RangeMin || Angle >= Context.RangeMax)
+				{
+					OnRejected(Candidate, ETargetSystemRejectReason::WrongSide, Angle);
+					continue;
+				}
+			}
+
+			if (NumKept != Index)
+			{
+				Candidates[NumKept] = Candidate;
+			}
+
+			NumKept++;
+		}
+
+		Candidates.SetNum(NumKept);
+	}
+
+	// Dispatches once to the FilterCandidates() specialization of the query configuration
+	template <typename CandidateType, typename RejectFunctorType>
+	void DispatchFilterCandidates(const bool bFilterBySide, const FQueryKernelContext& Context, TArray<CandidateType>& Candidates, RejectFunctorType&& OnRejected)
+	{
+		if (Context.View.bIsValid && bFilterBySide)
+		{
+			FilterCandidates(TQueryPolicy<true, true>(), Context, Candidates, OnRejected);
+		}
+		else if (Context.View.bIsValid)
+		{
+			FilterCandidates(TQueryPolicy<true, false>(), Context, Candidates, OnRejected);
+		}
+		else if (bFilterBySide)
+		{
+			FilterCandidates(TQueryPolicy<false, true>(), Context, Candidates, OnRejected);
+		}
+		else
+		{
+			FilterCandidates(TQueryPolicy<false, false>(), Context, Candidates, OnRejected);
+		}
+	}
+}
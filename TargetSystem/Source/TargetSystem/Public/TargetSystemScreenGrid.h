@@ -0,0 +1,97 @@
+// Copyright 2018-2021 Mickael Daniel. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class AActor;
+
+/**
+ * Uniform bucket grid of candidates projected on screen.
+ *
+ * Built once per frame from the projected lock points of candidates, it answers "nearest to a screen point" and
+ * "nearest in a screen direction" queries by only visiting the cells around the query point, instead of projecting
+ * and comparing every candidate each time.
+ */
+class TARGETSYSTEM_API FTargetSystemScreenGrid
+{
+public:
+	struct FEntry
+	{
+		AActor* Actor = nullptr;
+		int32 LockPointIndex = 0;
+		FVector WorldLocation = FVector::ZeroVector;
+		FVector2D ScreenLocation = FVector2D::ZeroVector;
+	};
+
+	/**
+	 * Builds the grid from entries, which must be within the viewport.
+	 *
+	 * @param InViewportSize Size of the viewport, in pixels
+	 * @param InEntries Projected candidates
+	 * @param InCellSize Size of a grid cell, in pixels
+	 * @param InFrameNumber Frame the grid is built for (GFrameCounter)
+	 */
+	void Build(const FVector2D& InViewportSize, TArray<FEntry>&& InEntries, float InCellSize, uint64 InFrameNumber);
+
+	void Reset();
+
+	// Whether the grid was built for the given frame (GFrameCounter)
+	bool IsBuiltForFrame(const uint64 InFrameNumber) const
+	{
+		return bIsBuilt && FrameNumber == InFrameNumber;
+	}
+
+	const TArray<FEntry>& GetEntries() const
+	{
+		return Entries;
+	}
+
+	FVector2D GetViewportSize() const
+	{
+		return ViewportSize;
+	}
+
+	/**
+	 * Returns the index of the entry nearest to Point, or INDEX_NONE.
+	 *
+	 * @param Point Screen location to search from, in pixels
+	 * @param MaxDistance Entries further than this (in pixels) are ignored. 0 for no limit.
+	 * @param ExcludedEntries Entries to skip, indexed like GetEntries()
+	 */
+	int32 FindNearest(const FVector2D& Point, float MaxDistance, const TBitArray<>& ExcludedEntries) const;
+
+	/**
+	 * Returns the index of the entry nearest to Origin in the given Direction, or INDEX_NONE.
+	 *
+	 * Entries are scored by their distance along Direction, plus twice their distance away from it, so that entries
+	 * aligned with Direction are preferred.
+	 *
+	 * @param Origin Screen location to search from, in pixels
+	 * @param Direction Screen direction to search in (ex: stick vector, Y pointing down)
+	 * @param MaxAngleDegrees Entries further than this angle from Direction are ignored
+	 * @param ExcludedEntries Entries to skip, indexed like GetEntries()
+	 */
+	int32 FindInDirection(const FVector2D& Origin, const FVector2D& Direction, float MaxAngleDegrees, const TBitArray<>& ExcludedEntries) const;
+
+private:
+	FIntPoint GetCell(const FVector2D& ScreenLocation) const;
+
+	// Calls Functor with the index of every cell at exactly Ring cells (Chebyshev distance) from Center
+	template <typename FunctorType>
+	void ForEachCellInRing(const FIntPoint& Center, int32 Ring, FunctorType&& Functor) const;
+
+	TArray<FEntry> Entries;
+
+	// Entry indices sorted by cell, and the start of each cell in it (NumCells + 1 items)
+	TArray<int32> CellEntries;
+	TArray<int32> CellStarts;
+
+	FVector2D ViewportSize = FVector2D::ZeroVector;
+	float CellSize = 1.0f;
+	int32 NumCellsX = 0;
+	int32 NumCellsY = 0;
+
+	uint64 FrameNumber = 0;
+	bool bIsBuilt = false;
+};
@@ -0,0 +1,67 @@
+// Copyright 2018-2021 Mickael Daniel. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "TargetSystemSoakCommandlet.generated.h"
+
+class APawn;
+class UTargetSystemComponent;
+class UWorld;
+
+/**
+ * Headless soak test of lock on / switch / lock off cycles, to catch leaks of UObjects (ex: lock on widgets) over long
+ * sessions.
+ *
+ * Loads a map, spawns pawns with a Target System Component, and drives scripted cycles on all of them while ticking the
+ * world. UObject count, memory, the time of the full purge each sample forces, and cycle latency are sampled to a CSV
+ * file, and the commandlet fails if the UObject count keeps growing.
+ *
+ * Usage:
+ *
+ *   UnrealEditor-Cmd.exe Project.uproject -run=TargetSystemSoak -Map=/Game/Maps/TestMap [-Cycles=5000] [-Pawns=16]
+ *     [-SampleEvery=50] [-Spacing=300] [-DeltaSeconds=0.0333] [-PawnClass=/Script/Engine.DefaultPawn] [-Output=Path.csv]
+ */
+UCLASS()
+class TARGETSYSTEM_API UTargetSystemSoakCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UTargetSystemSoakCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+private:
+	struct FSample
+	{
+		int32 Cycle = 0;
+		double Time = 0.0;
+		int32 NumObjects = 0;
+		uint64 UsedPhysicalMemory = 0;
+
+		// Time of the full purge forced before counting objects, not of the garbage collections of the cycles themselves
+		double ForcedPurgeTime = 0.0;
+
+		double CycleTime = 0.0;
+		double TickTime = 0.0;
+	};
+
+	UWorld* LoadWorld(const FString& MapName) const;
+	void DestroyWorld(UWorld* World) const;
+
+	TArray<UTargetSystemComponent*> SpawnPawns(UWorld* World, UClass* PawnClass, int32 NumPawns, float Spacing) const;
+
+	// Runs one lock on / switch / lock off cycle on every component, ticking the world in between. Returns the time spent in the component calls.
+	double RunCycle(UWorld* World, const TArray<UTargetSystemComponent*>& Components, int32 Cycle, float DeltaSeconds, double& OutTickTime) const;
+
+	FSample TakeSample(int32 Cycle, double StartTime, double CycleTime, double TickTime) const;
+
+	static bool WriteCsv(const FString& Filename, const TArray<FSample>& Samples);
+
+	// Whether the lowest value of the last quarter of samples is higher than the lowest value of the first quarter,
+	// ignoring the first WarmupSamples values. Comparing floors ignores noise (a collection happening to run right
+	// before a sample) in both directions, while a leak raises the floor however it shows up.
+	static bool IsSustainedGrowth(const TArray<FSample>& Samples, int32 WarmupSamples, TFunctionRef<uint64(const FSample&)> GetValue, uint64& OutEarlyMin, uint64& OutLateMin);
+};
@@ -0,0 +1,163 @@
+// Copyright 2018-2021 Mickael Daniel. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "TargetSystemTypes.h"
+#include "UObject/ObjectKey.h"
+#include "TargetSystemSubsystem.generated.h"
+
+class ULevel;
+class USceneComponent;
+
+DECLARE_MULTICAST_DELEGATE_OneParam(FTargetSystemOnTargetableChanged, AActor* /* TargetActor */);
+
+// What the last tick of UTargetSystemSubsystem spent registering actors of levels streamed in
+struct FTargetSystemRegistryTickStats
+{
+	// Time (in seconds) spent registering actors
+	double Time = 0.0;
+
+	// Time (in seconds) already spent when the last batch of actors started. The budget is checked before each batch,
+	// so this stays within TargetSystem.RegistryTimeBudgetMs (the first batch of a tick always runs).
+	double LastBatchStartTime = 0.0;
+
+	int32 NumBatches = 0;
+	int32 NumRegistered = 0;
+};
+
+/**
+ * World Subsystem shared by every Target System Component of a world.
+ *
+ * Targetable actors use it to notify locked on components that their targetable state changed, so that components
+ * don't have to poll ITargetSystemTargetableInterface::IsTargetable() every frame.
+ *
+ * It also maintains the registry of targetable actors used by the Registry candidate source. Actors are registered
+ * per level: levels streamed in (including World Partition cells) are registered in batches spread over frames under a
+ * time budget (TargetSystem.RegistryTimeBudgetMs), and levels streamed out are unregistered at once. A level's actors
+ * are found by queries once the whole level is registered.
+ */
+UCLASS()
+class TARGETSYSTEM_API UTargetSystemSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+	friend class FTargetSystemBenchmarks;
+
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	/**
+	 * Call this whenever the value returned by ITargetSystemTargetableInterface::IsTargetable() changes for an actor
+	 * (ex: when it dies), so that any component locked on it can react right away.
+	 *
+	 * @param TargetActor The actor whose targetable state changed
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Target System")
+	void NotifyTargetableChanged(AActor* TargetActor);
+
+	// Native event broadcast by NotifyTargetableChanged()
+	FTargetSystemOnTargetableChanged OnTargetableChanged;
+
+	/**
+	 * Returns the lock points of the actor's class. Actors without lock points have a single default one (the actor location).
+	 *
+	 * Lock points are gathered once per class and never modified afterwards, so this is a map lookup after the first
+	 * call, and the returned view stays valid for as long as the subsystem.
+	 */
+	TConstArrayView<FTargetSystemLockPoint> GetLockPoints(const AActor* Actor);
+
+	// Returns the Scene Component a lock point is attached to, or nullptr if it cannot be found
+	static USceneComponent* FindLockPointComponent(const AActor* Actor, const FTargetSystemLockPoint& LockPoint);
+
+	// Returns the world location of a lock point, relative to its already resolved component
+	static FVector GetLockPointLocation(const AActor* Actor, const USceneComponent* Component, const FTargetSystemLockPoint& LockPoint);
+
+	/**
+	 * Starts registering actors of ActorClass (every actor if None), for the Registry candidate source.
+	 *
+	 * Levels already loaded are registered again over the next frames, under the same time budget as levels streamed
+	 * in. Actors registered for other classes stay registered until then. Does nothing if a parent class is already
+	 * registered.
+	 */
+	void RegisterTargetableClass(TSubclassOf<AActor> ActorClass);
+
+	// Calls Callback with every registered actor that is still valid, in no particular order
+	template <typename FunctorType>
+	void ForEachRegisteredTarget(FunctorType&& Callback)
+	{
+		for (TPair<TObjectKey<ULevel>, TArray<TWeakObjectPtr<AActor>>>& Pair : LevelTargets)
+		{
+			// Destroyed actors are removed lazily, as they are found
+			TArray<TWeakObjectPtr<AActor>>& Actors = Pair.Value;
+			for (int32 Index = Actors.Num() - 1; Index >= 0; Index--)
+			{
+				AActor* Actor = Actors[Index].Get();
+				if (!IsValid(Actor))
+				{
+					Actors.RemoveAtSwap(Index);
+					continue;
+				}
+
+				Callback(Actor);
+			}
+		}
+	}
+
+	// Returns the number of registered actors, including destroyed ones not removed yet
+	int32 GetNumRegisteredTargets() const;
+
+	// Returns the number of levels whose actors are still being registered
+	int32 GetNumPendingLevels() const;
+
+	// Returns what the last tick spent registering actors, see TargetSystem.RegistryTimeBudgetMs
+	const FTargetSystemRegistryTickStats& GetLastRegistryTickStats() const;
+
+private:
+	// Lock points of every class seen so far
+	TMap<TObjectKey<UClass>, TArray<FTargetSystemLockPoint>> LockPoints;
+
+	//~ Registry
+
+	struct FPendingLevel
+	{
+		TWeakObjectPtr<ULevel> Level;
+		int32 NextActorIndex = 0;
+
+		// Actors registered so far, replacing the level's registered actors once every actor was checked
+		TArray<TWeakObjectPtr<AActor>> Targets;
+	};
+
+	// Classes whose actors are registered, see RegisterTargetableClass()
+	UPROPERTY()
+	TArray<UClass*> TargetableClasses;
+
+	// Registered actors per level, so that a level streamed out is unregistered at once
+	TMap<TObjectKey<ULevel>, TArray<TWeakObjectPtr<AActor>>> LevelTargets;
+
+	// Levels whose actors are being registered, first in first out
+	TArray<FPendingLevel> PendingLevels;
+
+	FTargetSystemRegistryTickStats LastRegistryTickStats;
+
+	FDelegateHandle LevelAddedToWorldHandle;
+	FDelegateHandle LevelRemovedFromWorldHandle;
+	FDelegateHandle ActorSpawnedHandle;
+
+	bool IsTargetableClass(const AActor* Actor) const;
+
+	// Registers the actors of a level (again) over the next frames
+	void QueueLevel(ULevel* Level);
+
+	// Registers actors of pending levels until TimeBudget (in seconds) is spent, recording it in LastRegistryTickStats.
+	// Returns the number of actors registered.
+	int32 ProcessPendingLevels(double TimeBudget);
+
+	void OnLevelAddedToWorld(ULevel* Level, UWorld* World);
+	void OnLevelRemovedFromWorld(ULevel* Level, UWorld* World);
+	void OnActorSpawned(AActor* Actor);
+};
@@ -4,6 +4,7 @@
 
 #include "CoreMinimal.h"
 #include "UObject/Interface.h"
+#include "TargetSystemTypes.h"
 #include "TargetSystemTargetableInterface.generated.h"
 
 // This class does not need to be modified.
@@ -22,6 +23,17 @@ class TARGETSYSTEM_API ITargetSystemTargetableInterface
 
 	// Add interface functions to this class. This is the class that will be inherited to implement this interface.
 public:
+	// Whether this actor can be targeted. Call UTargetSystemSubsystem::NotifyTargetableChanged() when the returned value changes.
 	UFUNCTION(BlueprintCallable, BlueprintNativeEvent, Category = "Target System")
 	bool IsTargetable() const;
+
+	/**
+	 * The points of this actor that can be locked on. Returns an empty array to lock on the actor location.
+	 *
+	 * This is only called once per class, on the Class Default Object, and cached by UTargetSystemSubsystem. The first
+	 * lock point is the one used when switching target with axis input.
+	 */
+	UFUNCTION(BlueprintCallable, BlueprintNativeEvent, Category = "Target System")
+	TArray<FTargetSystemLockPoint> GetLockPoints() const;
+	virtual TArray<FTargetSystemLockPoint> GetLockPoints_Implementation() const;
 };
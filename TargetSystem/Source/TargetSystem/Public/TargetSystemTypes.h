@@ -0,0 +1,382 @@
+// Copyright 2018-2021 Mickael Daniel. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/Class.h"
+#include "UObject/ObjectKey.h"
+#include "TargetSystemTypes.generated.h"
+
+class AActor;
+class UPackageMap;
+
+// Where a target query gets its candidates from.
+UENUM(BlueprintType)
+enum class ETargetSystemCandidateSource : uint8
+{
+	// Every actor of TargetableActors class in the world
+	ActorIterator,
+
+	// Actors currently perceived by the owner's AI Perception Component (falls back to ActorIterator without one).
+	//
+	// Candidates recently seen by the Sight sense skip line traces.
+	AIPerception,
+
+	// Actors with a component overlapping a sphere of MinimumDistanceToEnable radius on TargetableCollisionChannel.
+	//
+	// Range culling is done by the physics broadphase, instead of iterating every actor of the world.
+	PhysicsOverlap,
+
+	// Actors of TargetableActors class registered by UTargetSystemSubsystem as their level streams in.
+	//
+	// Iterates registered actors only, instead of every actor of the world. Actors of a level that just streamed in may
+	// take a few frames to be registered (see TargetSystem.RegistryTimeBudgetMs).
+	Registry
+};
+
+// How TargetActor() and TargetActorWithAxisInput() pick a target among visible candidates.
+UENUM(BlueprintType)
+enum class ETargetSystemSelectionMode : uint8
+{
+	// Nearest target to the owner, switching with the angle around the owner
+	ClosestToCharacter,
+
+	// Nearest target to the crosshair on screen, switching to the nearest target on screen in the axis direction.
+	//
+	// Requires a Player Controller, falls back to ClosestToCharacter otherwise.
+	ClosestToCrosshair
+};
+
+// The reason why a candidate was discarded during a target query.
+UENUM(BlueprintType)
+enum class ETargetSystemRejectReason : uint8
+{
+	// Candidate passed every filter (it may still not be the selected one, see Score)
+	None,
+
+	// ITargetSystemTargetableInterface::IsTargetable() returned false
+	NotTargetable,
+
+	// Line trace to the candidate hit something else
+	Occluded,
+
+	// Candidate is not within the owner's viewport
+	OffScreen,
+
+	// Candidate is further than MinimumDistanceToEnable
+	OutOfRange,
+
+	// Candidate is not on the side requested by axis input when switching target
+	WrongSide
+};
+
+/**
+ * A point of a targetable actor that can be locked on (ex: head, limbs or parts of a boss).
+ *
+ * Returned by ITargetSystemTargetableInterface::GetLockPoints().
+ */
+USTRUCT(BlueprintType)
+struct FTargetSystemLockPoint
+{
+	GENERATED_BODY()
+
+	// The name of the Scene Component to lock on.
+	//
+	// If None, the first Mesh Component is used when SocketName is set, the Root Component otherwise.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Target System")
+	FName ComponentName = NAME_None;
+
+	// The Socket or Bone name to lock on. If None, the Component location is used.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Target System")
+	FName SocketName = NAME_None;
+
+	// Whether this is the implicit lock point of actors without lock points (the actor location)
+	bool IsDefault() const
+	{
+		return ComponentName == NAME_None && SocketName == NAME_None;
+	}
+};
+
+// A point of a candidate tested for visibility, see UTargetSystemComponent::VisibilitySamples.
+UENUM(BlueprintType)
+enum class ETargetSystemVisibilitySampleType : uint8
+{
+	// The lock point being tested (the actor location for actors without lock points)
+	LockPoint,
+
+	// Center of the bounds of the actor's colliding components
+	BoundsCenter,
+
+	// Near the top of the bounds of the actor's colliding components (ex: head showing above low cover)
+	BoundsTop,
+
+	// A Socket or Bone of the actor's first Mesh Component (ex: head)
+	Socket
+};
+
+USTRUCT(BlueprintType)
+struct FTargetSystemVisibilitySample
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Target System")
+	ETargetSystemVisibilitySampleType Type = ETargetSystemVisibilitySampleType::LockPoint;
+
+	// The Socket or Bone name, for Socket samples. Skipped on actors without it.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Target System", meta = (EditCondition = "Type == ETargetSystemVisibilitySampleType::Socket"))
+	FName SocketName = NAME_None;
+};
+
+/**
+ * Lock state replicated from server to simulated proxies.
+ *
+ * Serialized as a single byte of quantized flags (locked bit + lock point index), followed by the target net GUID
+ * when locked.
+ */
+USTRUCT()
+struct FTargetSystemReplicatedLock
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	AActor* Target = nullptr;
+
+	UPROPERTY()
+	uint8 LockPointIndex = 0;
+
+	UPROPERTY()
+	bool bIsLocked = false;
+
+	// Lock point index is quantized to the 7 bits left after the locked flag
+	static constexpr uint8 MaxLockPointIndex = 127;
+
+	bool NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess);
+
+	bool operator==(const FTargetSystemReplicatedLock& Other) const
+	{
+		return Target == Other.Target && LockPointIndex == Other.LockPointIndex && bIsLocked == Other.bIsLocked;
+	}
+
+	bool operator!=(const FTargetSystemReplicatedLock& Other) const
+	{
+		return !(*this == Other);
+	}
+};
+
+template<>
+struct TStructOpsTypeTraits<FTargetSystemReplicatedLock> : public TStructOpsTypeTraitsBase2<FTargetSystemReplicatedLock>
+{
+	enum
+	{
+		WithNetSerializer = true,
+		WithIdenticalViaEquality = true
+	};
+};
+
+// Key of the per frame cache of visibility tests. The same actor can be tested with different lock points and ignored actors.
+struct FTargetSystemVisibilityCacheKey
+{
+	const AActor* Actor = nullptr;
+	FVector TargetLocation = FVector::ZeroVector;
+	uint32 IgnoredActorsHash = 0;
+	bool bNoHitIsVisible = false;
+
+	bool operator==(const FTargetSystemVisibilityCacheKey& Other) const
+	{
+		return Actor == Other.Actor
+			&& TargetLocation == Other.TargetLocation
+			&& IgnoredActorsHash == Other.IgnoredActorsHash
+			&& bNoHitIsVisible == Other.bNoHitIsVisible;
+	}
+
+	friend uint32 GetTypeHash(const FTargetSystemVisibilityCacheKey& Key)
+	{
+		const uint32 Hash = HashCombineFast(GetTypeHash(Key.Actor), GetTypeHash(Key.TargetLocation));
+		return HashCombineFast(Hash, HashCombineFast(Key.IgnoredActorsHash, Key.bNoHitIsVisible ? 1u : 0u));
+	}
+};
+
+// A target recently locked off, see UTargetSystemComponent::bPreferRecentTargets.
+struct FTargetSystemRecentTarget
+{
+	TWeakObjectPtr<AActor> Actor;
+	int32 LockPointIndex = 0;
+
+	// Location of the locked on point when locked off
+	FVector LastKnownLocation = FVector::ZeroVector;
+
+	// World time in seconds when locked off
+	double Timestamp = 0.0;
+
+	// Whether the lock was broken by losing line of sight (see UTargetSystemComponent::bRelockOnRegainSight)
+	bool bLostSight = false;
+};
+
+/**
+ * Fixed capacity ring buffer of recently locked off targets, overwriting the oldest entry when full.
+ *
+ * An actor has at most one entry, updated in place when locked off again.
+ */
+struct FTargetSystemRecentTargets
+{
+	// Resets entries when the capacity changes. A capacity of 0 disables the buffer.
+	void SetCapacity(const int32 InCapacity)
+	{
+		const int32 NewCapacity = FMath::Max(InCapacity, 0);
+		if (NewCapacity != Entries.Num())
+		{
+			Entries.Reset();
+			Entries.SetNum(NewCapacity);
+			NextIndex = 0;
+		}
+	}
+
+	void Add(AActor* Actor, const int32 LockPointIndex, const FVector& Location, const double Timestamp)
+	{
+		if (Entries.Num() == 0)
+		{
+			return;
+		}
+
+		FTargetSystemRecentTarget* Entry = Find(Actor);
+		if (!Entry)
+		{
+			Entry = &Entries[NextIndex];
+			NextIndex = (NextIndex + 1) % Entries.Num();
+		}
+
+		Entry->Actor = Actor;
+		Entry->LockPointIndex = LockPointIndex;
+		Entry->LastKnownLocation = Location;
+		Entry->Timestamp = Timestamp;
+		Entry->bLostSight = false;
+	}
+
+	FTargetSystemRecentTarget* Find(const AActor* Actor)
+	{
+		return Entries.FindByPredicate([Actor](const FTargetSystemRecentTarget& Entry)
+		{
+			return Entry.Actor.Get() == Actor;
+		});
+	}
+
+	void Remove(const AActor* Actor)
+	{
+		if (FTargetSystemRecentTarget* Entry = Find(Actor))
+		{
+			*Entry = FTargetSystemRecentTarget();
+		}
+	}
+
+	// Returns the most recent entry locked off after MinTimestamp and passing Predicate, if any
+	template <typename PredicateType>
+	const FTargetSystemRecentTarget* FindMostRecent(const double MinTimestamp, PredicateType&& Predicate) const
+	{
+		const FTargetSystemRecentTarget* MostRecent = nullptr;
+		for (const FTargetSystemRecentTarget& Entry : Entries)
+		{
+			if (Entry.Actor.IsValid() && Entry.Timestamp >= MinTimestamp && (!MostRecent || Entry.Timestamp > MostRecent->Timestamp) && Predicate(Entry))
+			{
+				MostRecent = &Entry;
+			}
+		}
+
+		return MostRecent;
+	}
+
+	// Slots of the buffer, with a null Actor when empty
+	const TArray<FTargetSystemRecentTarget>& GetEntries() const
+	{
+		return Entries;
+	}
+
+private:
+	TArray<FTargetSystemRecentTarget> Entries;
+	int32 NextIndex = 0;
+};
+
+// A single actor considered during a target query.
+struct FTargetSystemQueryCandidate
+{
+	TWeakObjectPtr<const AActor> Actor;
+	FVector Location = FVector::ZeroVector;
+	ETargetSystemRejectReason RejectReason = ETargetSystemRejectReason::None;
+
+	// Lower is better. Distance to the owner for TargetActor(), distance to the current target when switching.
+	float Score = 0.0f;
+};
+
+/**
+ * Breakdown of the last TargetActor() / TargetActorWithAxisInput() query.
+ *
+ * Only filled while a query is running, and read by the Gameplay Debugger category to show why a given
+ * target was (or was not) picked, and where the time was spent. Never recorded in shipping builds, and
+ * otherwise only while the category is displayed or TargetSystem.RecordQueryStats is set.
+ */
+struct FTargetSystemQueryStats
+{
+	// TargetActor / TargetActorWithAxisInput
+	FName QueryName = NAME_None;
+
+	// World time in seconds when the query ran
+	double Timestamp = 0.0;
+
+	TArray<FTargetSystemQueryCandidate> Candidates;
+	TWeakObjectPtr<const AActor> SelectedActor;
+
+	int32 NumTraces = 0;
+
+	// Line traces skipped because visibility was already known (ex: AI Perception sight, render visibility)
+	int32 NumTracesAvoided = 0;
+
+	// Visibility checks answered by a trace made earlier in the same frame (see TraceVisibilitySamples())
+	int32 NumVisibilityCacheHits = 0;
+
+	// Candidates gathered from CandidateSource, each time iterating actors of the world, the registry or an overlap
+	int32 NumGathers = 0;
+
+	// Time spent in each phase of the query, in seconds. Filtering covers range and screen checks, scoring covers
+	// sorting and selection, including line traces.
+	double GatherTime = 0.0;
+	double FilterTime = 0.0;
+	double ScoreTime = 0.0;
+
+	void Reset(const FName InQueryName, const double InTimestamp)
+	{
+		QueryName = InQueryName;
+		Timestamp = InTimestamp;
+		Candidates.Reset();
+		CandidateIndices.Reset();
+		SelectedActor.Reset();
+		NumTraces = 0;
+		NumTracesAvoided = 0;
+		NumVisibilityCacheHits = 0;
+		NumGathers = 0;
+		GatherTime = 0.0;
+		FilterTime = 0.0;
+		ScoreTime = 0.0;
+	}
+
+	FTargetSystemQueryCandidate* FindCandidate(const AActor* Actor)
+	{
+		const int32* Index = CandidateIndices.Find(Actor);
+		return Index ? &Candidates[*Index] : nullptr;
+	}
+
+	FTargetSystemQueryCandidate& FindOrAddCandidate(const AActor* Actor)
+	{
+		if (const int32* Index = CandidateIndices.Find(Actor))
+		{
+			return Candidates[*Index];
+		}
+
+		CandidateIndices.Add(Actor, Candidates.Num());
+		FTargetSystemQueryCandidate& Candidate = Candidates.AddDefaulted_GetRef();
+		Candidate.Actor = Actor;
+		return Candidate;
+	}
+
+private:
+	// Index in Candidates of each recorded actor, so that recording stays O(1) per candidate
+	TMap<TObjectKey<AActor>, int32> CandidateIndices;
+};
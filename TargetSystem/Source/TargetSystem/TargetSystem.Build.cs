@@ -37,8 +37,10 @@ public class TargetSystem : ModuleRules
 		PrivateDependencyModuleNames.AddRange(
 			new string[]
 			{
+				"AIModule",
 				"CoreUObject",
 				"Engine",
+				"NetCore",
                 "UMG",
                 "Slate",
 				"SlateCore"
@@ -53,5 +55,14 @@ public class TargetSystem : ModuleRules
 				// ... add any modules that your module loads dynamically here ...
 			}
 			);
+
+		// Registers the TargetSystem Gameplay Debugger category (defines WITH_GAMEPLAY_DEBUGGER)
+		SetupGameplayDebuggerSupport(Target);
+
+		// Automation tests starting Play In Editor sessions
+		if (Target.bBuildEditor)
+		{
+			PrivateDependencyModuleNames.Add("UnrealEd");
+		}
 	}
 }